@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import os
+import random
+import shlex
+import sys
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(
+        description="Generate a synthetic C/C++ project and its cl_output.txt"
+    )
+    parser.add_argument("--out", required=True, help="output directory")
+    parser.add_argument("--lang", choices=["c", "c++"], default="c++")
+    parser.add_argument("--num-tus", type=int, default=200)
+    parser.add_argument("--num-headers", type=int, default=50)
+    parser.add_argument(
+        "--header-fanin", type=int, default=10, help="headers included per TU"
+    )
+    parser.add_argument(
+        "--funcs-per-file", type=int, default=20, help="functions per TU and header"
+    )
+    parser.add_argument(
+        "--macro-density",
+        type=float,
+        default=0.5,
+        help="#defines per function, half of them in disabled #if branches",
+    )
+    parser.add_argument(
+        "--call-degree", type=int, default=4, help="calls made by each function"
+    )
+    parser.add_argument(
+        "--num-hubs",
+        type=int,
+        default=5,
+        help="functions in a common header called from everywhere",
+    )
+    parser.add_argument("--seed", type=int, default=0)
+    return parser.parse_args(argv)
+
+
+def write_file(path, lines):
+    with open(path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def gen_macros(rng, prefix, count):
+    lines = []
+    for idx in range(count):
+        name = f"{prefix}_M{idx}"
+        if idx % 2 == 0:
+            lines.append(f"#define {name}(x) ((x) * {rng.randint(1, 9)})")
+        else:
+            lines += [
+                f"#ifdef {prefix}_DISABLED",
+                f"#define {name}(x) ((x) + {rng.randint(1, 9)})",
+                "#endif",
+            ]
+    return lines
+
+
+def gen_function(rng, name, callees, is_inline):
+    storage = "static inline " if is_inline else ""
+    lines = [f"{storage}int {name}(int x) {{", "  int acc = x;"]
+    for callee in callees:
+        lines.append(f"  acc += {callee}(acc & {rng.randint(1, 255)});")
+    lines += ["  return acc;", "}", ""]
+    return lines
+
+
+def main(argv):
+    args = parse_args(argv[1:])
+    rng = random.Random(args.seed)
+    ext = "c" if args.lang == "c" else "cpp"
+
+    out_dir = os.path.abspath(args.out)
+    include_dir = os.path.join(out_dir, "include")
+    src_dir = os.path.join(out_dir, "src")
+    os.makedirs(include_dir, exist_ok=True)
+    os.makedirs(src_dir, exist_ok=True)
+
+    num_macros = int(args.funcs_per_file * args.macro_density)
+
+    # Hub functions, called from every file
+    hubs = [f"hub_{idx}" for idx in range(args.num_hubs)]
+    lines = ["#pragma once", ""] + gen_macros(rng, "HUB", num_macros) + [""]
+    for hub in hubs:
+        lines += gen_function(rng, hub, [], True)
+    write_file(os.path.join(include_dir, "hubs.h"), lines)
+
+    # Headers with inline functions, calling hubs and earlier functions
+    header_funcs = []
+    for h_idx in range(args.num_headers):
+        names = [f"h{h_idx}_f{idx}" for idx in range(args.funcs_per_file)]
+        lines = ['#pragma once', '#include "hubs.h"', ""]
+        lines += gen_macros(rng, f"H{h_idx}", num_macros) + [""]
+        for idx, name in enumerate(names):
+            candidates = hubs + names[:idx]
+            callees = rng.sample(candidates, min(args.call_degree, len(candidates)))
+            lines += gen_function(rng, name, callees, True)
+        write_file(os.path.join(include_dir, f"header_{h_idx}.h"), lines)
+        header_funcs.append(names)
+
+    # Translation units including a random subset of the headers
+    cl_lines = []
+    num_decls = 0
+    for tu_idx in range(args.num_tus):
+        included = rng.sample(
+            range(args.num_headers), min(args.header_fanin, args.num_headers)
+        )
+        lines = [f'#include "header_{h_idx}.h"' for h_idx in sorted(included)]
+        lines += [""] + gen_macros(rng, f"TU{tu_idx}", num_macros) + [""]
+
+        visible = list(hubs)
+        for h_idx in included:
+            visible += header_funcs[h_idx]
+
+        names = [f"tu{tu_idx}_f{idx}" for idx in range(args.funcs_per_file)]
+        for idx, name in enumerate(names):
+            candidates = visible + names[:idx]
+            callees = rng.sample(candidates, min(args.call_degree, len(candidates)))
+            lines += gen_function(rng, name, callees, False)
+        num_decls += len(names)
+
+        src_path = os.path.join(src_dir, f"tu_{tu_idx}.{ext}")
+        write_file(src_path, lines)
+
+        # Same layout as the lines written by cc_wrapper/cxx_wrapper
+        cl_lines.append(
+            "shlex: "
+            + shlex.join(
+                [
+                    out_dir,
+                    "-I",
+                    include_dir,
+                    "-c",
+                    src_path,
+                    "-o",
+                    os.path.join(out_dir, f"tu_{tu_idx}.o"),
+                ]
+            )
+        )
+
+    write_file(os.path.join(out_dir, "cl_output.txt"), cl_lines)
+
+    num_decls += args.num_headers * args.funcs_per_file + args.num_hubs
+
+    # Read by run_bench.py
+    manifest = vars(args).copy()
+    manifest["out"] = out_dir
+    manifest["num_functions"] = num_decls
+    manifest["tus"] = [
+        {
+            "src_path": os.path.join(src_dir, f"tu_{tu_idx}.{ext}"),
+            "functions": [f"tu{tu_idx}_f{idx}" for idx in range(args.funcs_per_file)],
+        }
+        for tu_idx in range(args.num_tus)
+    ]
+    with open(os.path.join(out_dir, "project.json"), "w") as f:
+        json.dump(manifest, f, indent=2)
+    print(
+        f"Generated {args.num_tus} TUs, {args.num_headers} headers and "
+        f"{num_decls} functions in {out_dir}"
+    )
+    return 0
+
+
+if __name__ == "__main__":
+    exit(main(sys.argv))
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+CODE_DATA_KINDS = ["functions", "types", "enums", "global_variables", "macros"]
+
+
+def parse_args(argv):
+    parser = argparse.ArgumentParser(
+        description="Run the extractors on a project made by gen_project.py"
+    )
+    parser.add_argument("--project", required=True, help="gen_project.py output")
+    parser.add_argument("--build-dir", default="build", help="directory of the tools")
+    parser.add_argument("--output", default="bench_output.json")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1)
+    parser.add_argument(
+        "--max-tus",
+        type=int,
+        default=50,
+        help="TUs run through the per-file tools (parse_cpp, get_func_*)",
+    )
+    return parser.parse_args(argv)
+
+
+# Runs one process and returns its wall time in seconds and peak RSS in KB.
+def run(cmd, stdin_data=None, stdout=subprocess.DEVNULL):
+    start = time.monotonic()
+    process = subprocess.Popen(
+        cmd,
+        stdin=subprocess.PIPE if stdin_data is not None else subprocess.DEVNULL,
+        stdout=stdout,
+        stderr=subprocess.DEVNULL,
+    )
+    if stdin_data is not None:
+        process.stdin.write(stdin_data.encode())
+        process.stdin.close()
+    _, status, rusage = os.wait4(process.pid, 0)
+    wall_time = time.monotonic() - start
+    process.returncode = os.waitstatus_to_exitcode(status)
+    if process.returncode != 0:
+        raise RuntimeError(f"{cmd[0]} failed with code {process.returncode}")
+    return wall_time, rusage.ru_maxrss
+
+
+class Result:
+    def __init__(self, tool):
+        self.tool = tool
+        self.wall_time = 0.0
+        self.peak_rss = 0
+        self.num_tus = 0
+        self.num_decls = 0
+
+    def add_run(self, wall_time, peak_rss):
+        self.wall_time += wall_time
+        self.peak_rss = max(self.peak_rss, peak_rss)
+
+    def to_json(self):
+        return {
+            "tool": self.tool,
+            "wall_time_s": round(self.wall_time, 3),
+            "peak_rss_kb": self.peak_rss,
+            "num_tus": self.num_tus,
+            "num_decls": self.num_decls,
+            "tus_per_s": round(self.num_tus / self.wall_time, 2),
+            "decls_per_s": round(self.num_decls / self.wall_time, 2),
+        }
+
+
+def compile_args(project):
+    return ["--", "-I", os.path.join(project["out"], "include")]
+
+
+def bench_gen_code_data(args, project, tmp_dir):
+    result = Result("gen_code_data")
+    output_path = os.path.join(tmp_dir, "code_data.json")
+    result.add_run(
+        *run(
+            [
+                os.path.join(args.build_dir, "gen_code_data"),
+                "-j",
+                str(args.jobs),
+                os.path.join(project["out"], "cl_output.txt"),
+                output_path,
+            ]
+        )
+    )
+
+    with open(output_path) as f:
+        code_data = json.load(f)
+    result.num_tus = len(project["tus"])
+    for file_entry in code_data.values():
+        for kind in CODE_DATA_KINDS:
+            result.num_decls += len(file_entry.get(kind, {}))
+    return result
+
+
+def bench_parse_cpp(args, project, tmp_dir):
+    result = Result("parse_cpp")
+    output_path = os.path.join(tmp_dir, "parse_cpp.json")
+    for tu in project["tus"][: args.max_tus]:
+        result.add_run(
+            *run(
+                [os.path.join(args.build_dir, "parse_cpp"), tu["src_path"], output_path]
+                + compile_args(project)
+            )
+        )
+        with open(output_path) as f:
+            result.num_decls += len(json.load(f))
+        result.num_tus += 1
+    return result
+
+
+def bench_get_func_list(args, project, tmp_dir):
+    result = Result("get_func_list")
+    output_path = os.path.join(tmp_dir, "get_func_list.txt")
+    for tu in project["tus"][: args.max_tus]:
+        with open(output_path, "w") as out:
+            result.add_run(
+                *run(
+                    [os.path.join(args.build_dir, "get_func_list"), tu["src_path"]]
+                    + compile_args(project),
+                    stdout=out,
+                )
+            )
+        with open(output_path) as f:
+            result.num_decls += sum(1 for line in f if line.strip())
+        result.num_tus += 1
+    return result
+
+
+def bench_get_func_src(args, project, tmp_dir):
+    result = Result("get_func_src")
+    output_path = os.path.join(tmp_dir, "get_func_src.json")
+    for tu in project["tus"][: args.max_tus]:
+        with open(output_path, "w") as out:
+            result.add_run(
+                *run(
+                    [
+                        os.path.join(args.build_dir, "get_func_src"),
+                        tu["src_path"],
+                        "--names",
+                        "-",
+                    ]
+                    + compile_args(project),
+                    stdin_data="\n".join(tu["functions"]) + "\n",
+                    stdout=out,
+                )
+            )
+        with open(output_path) as f:
+            result.num_decls += sum(len(defs) for defs in json.load(f).values())
+        result.num_tus += 1
+    return result
+
+
+def main(argv):
+    args = parse_args(argv[1:])
+
+    with open(os.path.join(args.project, "project.json")) as f:
+        project = json.load(f)
+
+    # The query server must not answer for the tools
+    os.environ.pop("FUNC_QUERY_SOCKET", None)
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="cpp_code_extractor_bench_") as tmp_dir:
+        for bench in [
+            bench_gen_code_data,
+            bench_parse_cpp,
+            bench_get_func_list,
+            bench_get_func_src,
+        ]:
+            result = bench(args, project, tmp_dir)
+            print(
+                f"{result.tool}: {result.wall_time:.2f}s, "
+                f"peak RSS {result.peak_rss // 1024} MB, "
+                f"{result.num_tus / result.wall_time:.1f} TUs/s, "
+                f"{result.num_decls / result.wall_time:.1f} decls/s"
+            )
+            results.append(result.to_json())
+
+    parameters = {key: value for key, value in project.items() if key != "tus"}
+    with open(args.output, "w") as f:
+        json.dump({"project": parameters, "jobs": args.jobs, "results": results}, f, indent=2)
+    print(f"Wrote results to {args.output}")
+    return 0
+
+
+if __name__ == "__main__":
+    exit(main(sys.argv))
@@ -1,6 +1,7 @@
 #ifndef COMPILE_COMMAND_HPP
 #define COMPILE_COMMAND_HPP
 
+#include <set>
 #include <string>
 #include <vector>
 class CompileCommand {
@@ -17,4 +18,24 @@ class CompileCommand {
   std::string              src_file_ = "";
 };
 
+// Reads either a compile_commands.json database or the
+// "<working_dir> <compile args> ..." lines written by cc_wrapper and
+// cxx_wrapper. Arguments are split like a shell does, @response-files are
+// expanded, and commands whose source path contains one of excludes are
+// skipped.
+std::vector<CompileCommand> read_compile_commands(
+    const char *compile_commands_path, const std::set<std::string> &excludes);
+
+// The compile args without the options that do not change how a translation
+// unit is parsed (outputs, dependency files, warnings, debug info, ...). -f
+// and -std= flags are sorted unless one overrides another.
+std::vector<std::string> normalize_compile_args(
+    const std::vector<std::string> &args);
+
+// Drops the commands that parse a source file the same way as an earlier
+// command, comparing normalized compile args. With one_config_per_file, only
+// the first command of each source file is kept. The order is preserved.
+std::vector<CompileCommand> plan_compile_commands(
+    const std::vector<CompileCommand> &commands, bool one_config_per_file);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,65 @@
+#ifndef CODE_DATA_FORMAT_HPP
+#define CODE_DATA_FORMAT_HPP
+
+#include <cstdint>
+
+// Layout of the binary code data file written by gen_code_data --format binary.
+// All integers are stored in the byte order of the host that wrote the file.
+//
+//   CodeDataHeader
+//   uint64_t       string_offsets[num_strings + 1]
+//   char           string_data[string_data_size]  (NUL-terminated strings)
+//   CodeDataRecord records[num_records]           (8-byte aligned)
+//   uint32_t       edges[num_edges]               (string ids of callees and
+//                                                  callers)
+//
+// Records are sorted by kind, name, file and parent, so all records of a name
+// can be found by binary search.
+
+static const char     CODE_DATA_MAGIC[4] = {'C', 'D', 'X', '1'};
+static const uint32_t CODE_DATA_VERSION = 1;
+static const uint32_t CODE_DATA_NO_STRING = UINT32_MAX;
+
+enum class CodeDataKind : uint32_t {
+  FUNCTION = 0,
+  VARIABLE = 1,  // Local variable of the function named by parent
+  GLOBAL_VARIABLE = 2,
+  TYPE = 3,
+  ENUM = 4,
+  MACRO = 5,
+  DISABLED_MACRO = 6,
+};
+
+struct CodeDataHeader {
+  char     magic[4];
+  uint32_t version;
+  uint64_t num_strings;
+  uint64_t string_offsets_offset;
+  uint64_t string_data_offset;
+  uint64_t string_data_size;
+  uint64_t num_records;
+  uint64_t records_offset;
+  uint64_t num_edges;
+  uint64_t edges_offset;
+};
+
+// Strings are referred to by their index in the string table.
+struct CodeDataRecord {
+  CodeDataKind kind;
+  uint32_t     file;
+  uint32_t     name;
+  uint32_t     parent;  // CODE_DATA_NO_STRING unless kind is VARIABLE
+  uint32_t     definition;
+  uint32_t     start_line;
+  uint32_t     end_line;
+  uint32_t     num_callees;
+  uint32_t     num_callers;
+  uint32_t     reserved;
+  uint64_t     callees_offset;  // Index of the first callee in edges
+  uint64_t     callers_offset;  // Index of the first caller in edges
+};
+
+static_assert(sizeof(CodeDataHeader) == 72, "unexpected header layout");
+static_assert(sizeof(CodeDataRecord) == 56, "unexpected record layout");
+
+#endif
\ No newline at end of file
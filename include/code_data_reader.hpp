@@ -0,0 +1,46 @@
+#ifndef CODE_DATA_READER_HPP
+#define CODE_DATA_READER_HPP
+
+#include <memory>
+#include <string>
+
+#include "code_data_format.hpp"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Read-only view on a binary code data file. The file is mapped into memory
+// and used in place, so opening it costs the same regardless of its size, and
+// lookups only touch the records they return.
+class CodeDataReader {
+ public:
+  // Returns false if the file cannot be read or is not a valid code data file.
+  bool open(const std::string &file_path);
+
+  llvm::ArrayRef<CodeDataRecord> get_records() const {
+    return records_;
+  }
+
+  // All records of the given kind and name, ordered by file.
+  llvm::ArrayRef<CodeDataRecord> find(CodeDataKind    kind,
+                                      llvm::StringRef name) const;
+  // The record of the given kind and name in the given file, or nullptr. For
+  // local variables, the one in the first function by name is returned.
+  const CodeDataRecord *find(CodeDataKind kind, llvm::StringRef name,
+                             llvm::StringRef file_path) const;
+
+  // Function names, to be looked up with find(CodeDataKind::FUNCTION, ...).
+  llvm::ArrayRef<uint32_t> get_callees(const CodeDataRecord &record) const;
+  llvm::ArrayRef<uint32_t> get_callers(const CodeDataRecord &record) const;
+
+  llvm::StringRef get_string(uint32_t id) const;
+
+ private:
+  std::unique_ptr<llvm::MemoryBuffer> buffer_;
+  llvm::ArrayRef<uint64_t>            string_offsets_;
+  const char                         *string_data_ = nullptr;
+  llvm::ArrayRef<CodeDataRecord>      records_;
+  llvm::ArrayRef<uint32_t>            edges_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef CODE_DATA_WRITER_HPP
+#define CODE_DATA_WRITER_HPP
+
+#include <jsoncpp/json/json.h>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "code_data_format.hpp"
+#include "llvm/ADT/StringMap.h"
+
+enum class OutputFormat {
+  JSON,    // One JSON object keyed by file path
+  JSONL,   // One {"<file_path>": {...}} object per line
+  BINARY,  // Memory-mappable layout described in code_data_format.hpp
+};
+
+// Writes code data one file entry at a time, so that the whole output is never
+// serialized into a single string. The styled JSON output is byte-identical to
+// Json::Value::toStyledString() of the whole object.
+class CodeDataWriter {
+ public:
+  CodeDataWriter(std::ostream &out, OutputFormat format, bool compact);
+
+  void write_file_entry(const std::string &file_path,
+                        const Json::Value &file_entry);
+  void finish();
+
+  size_t get_num_entries() const {
+    return num_entries_;
+  }
+
+ private:
+  std::string to_string(const Json::Value &value) const;
+
+  std::ostream                       &out_;
+  OutputFormat                        format_;
+  bool                                compact_;
+  size_t                              num_entries_ = 0;
+  std::unique_ptr<Json::StreamWriter> writer_;
+};
+
+// Converts code data into the binary format. Strings are interned, so file
+// paths and names shared by many entries are stored once. The file is written
+// by finish(), since the records are sorted across all entries.
+class BinaryCodeDataWriter {
+ public:
+  explicit BinaryCodeDataWriter(std::ostream &out);
+
+  void write_file_entry(const std::string &file_path,
+                        const Json::Value &file_entry);
+  void finish();
+
+  size_t get_num_entries() const {
+    return num_entries_;
+  }
+
+ private:
+  uint32_t intern(llvm::StringRef str);
+  void     add_record(CodeDataKind kind, uint32_t file, uint32_t parent,
+                      const std::string &name, const Json::Value &entry);
+  uint64_t add_edges(const Json::Value &names);
+
+  std::ostream                &out_;
+  size_t                       num_entries_ = 0;
+  llvm::StringMap<uint32_t>    string_ids_;
+  std::vector<llvm::StringRef> strings_;
+  std::vector<CodeDataRecord>  records_;
+  std::vector<uint32_t>        edges_;
+};
+
+bool parse_output_format(const std::string &name, OutputFormat &format);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+#ifndef CODE_MODEL_HPP
+#define CODE_MODEL_HPP
+
+#include <jsoncpp/json/json.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "macro_scanner.hpp"
+
+// Code data of one translation unit, or of all of them merged. This replaces
+// the nested Json::Value objects of the output while extracting: names and
+// paths are interned into integer ids, definitions are copied into an arena,
+// and each symbol is a fixed-size record in a hash map keyed by its name id.
+// A file is converted to the JSON layout of the output only when it is
+// written or cached.
+class CodeModel {
+ public:
+  enum class RecordKind {
+    MACRO,
+    ENUM,
+    TYPE,
+    GLOBAL_VARIABLE,
+  };
+
+  // Written while traversing one translation unit. A definition replaces the
+  // one of the same name in the same file.
+  void add_file(llvm::StringRef file_path);
+  void set_function(llvm::StringRef file_path, llvm::StringRef func_name,
+                    llvm::StringRef definition, int32_t start_line,
+                    int32_t end_line);
+  void set_variable(llvm::StringRef file_path, llvm::StringRef func_name,
+                    llvm::StringRef var_name, llvm::StringRef definition,
+                    int32_t start_line, int32_t end_line);
+  void set_record(RecordKind kind, llvm::StringRef file_path,
+                  llvm::StringRef name, llvm::StringRef definition,
+                  int32_t start_line, int32_t end_line);
+  void add_callee(llvm::StringRef file_path, llvm::StringRef func_name,
+                  llvm::StringRef callee_name);
+  void add_caller(llvm::StringRef file_path, llvm::StringRef func_name,
+                  llvm::StringRef caller_name);
+  void add_disabled_macro(llvm::StringRef file_path, llvm::StringRef name,
+                          llvm::StringRef definition, int32_t start_line,
+                          int32_t end_line);
+  // Marks the disabled macros of the file as known, even if there are none,
+  // e.g. because the file was preprocessed.
+  void set_preprocessed(llvm::StringRef file_path);
+
+  // Merges one file of other, e.g. of the model of one translation unit, the
+  // same way as merge_file_entry().
+  void merge_file(llvm::StringRef file_path, const CodeModel &other);
+  // Same as below, with the disabled macros of the file in other. Nothing
+  // changes if they are not known there.
+  void intersect_disabled_macros(llvm::StringRef  file_path,
+                                 const CodeModel &other);
+
+  // Merges the entry of one file from the output of a translation unit.
+  // Definitions of later translation units win, and call edges are unioned
+  // in the order they are first seen. "disabled_macros" is left to the
+  // methods below, since how it is merged depends on the extraction options.
+  void merge_file_entry(llvm::StringRef file_path, const Json::Value &entry);
+
+  bool has_file(llvm::StringRef file_path) const;
+
+  // Replaces the disabled macros of the file.
+  void set_disabled_macros(llvm::StringRef                         file_path,
+                           const std::vector<MacroDefinitionLine> &macros);
+  // Keeps the disabled macros of the file that are also in disabled_macros,
+  // or takes them as they are if the file has none yet.
+  void intersect_disabled_macros(llvm::StringRef    file_path,
+                                 const Json::Value &disabled_macros);
+  // Drops the disabled definitions that match the enabled macro of the same
+  // name in the file.
+  void remove_enabled_macros(llvm::StringRef file_path);
+
+  // File paths in the order of the JSON output.
+  std::vector<std::string> get_file_paths() const;
+  // The file in the JSON layout of the output. With
+  // omit_unknown_disabled_macros, "disabled_macros" is left out of files that
+  // no translation unit preprocessed, so that merge_code_data can tell them
+  // from files without disabled macros.
+  Json::Value to_json(llvm::StringRef file_path,
+                      bool omit_unknown_disabled_macros = false) const;
+
+ private:
+  struct CodeRecord {
+    llvm::StringRef definition;
+    int32_t         start_line = 0;
+    int32_t         end_line = 0;
+  };
+
+  using RecordMap = llvm::DenseMap<uint32_t, CodeRecord>;
+
+  struct FunctionRecord {
+    bool                      has_definition = false;
+    CodeRecord                record;
+    RecordMap                 variables;
+    llvm::SetVector<uint32_t> callees;
+    llvm::SetVector<uint32_t> callers;
+  };
+
+  using FunctionMap = llvm::DenseMap<uint32_t, FunctionRecord *>;
+  using DisabledMacroMap =
+      llvm::DenseMap<uint32_t, llvm::SmallVector<CodeRecord, 1>>;
+
+  struct FileRecord {
+    FunctionMap      functions;
+    RecordMap        macros;
+    RecordMap        enums;
+    RecordMap        types;
+    RecordMap        global_variables;
+    DisabledMacroMap disabled_macros;
+    bool             has_disabled_macros = false;
+  };
+
+  uint32_t        intern(llvm::StringRef str);
+  llvm::StringRef save(llvm::StringRef str);
+  FileRecord     &get_file(llvm::StringRef file_path);
+  FileRecord     *find_file(llvm::StringRef file_path) const;
+  FunctionRecord &get_function(FileRecord &file, llvm::StringRef func_name);
+  RecordMap      &get_records(FileRecord &file, RecordKind kind);
+  void            assign_record(CodeRecord &record, llvm::StringRef definition,
+                                int32_t start_line, int32_t end_line);
+  void            assign_record(CodeRecord &record, const Json::Value &entry);
+  void            merge_records(RecordMap &records, const Json::Value &entries);
+  void            merge_records(RecordMap &records, const CodeModel &other,
+                                const RecordMap &other_records);
+  void            merge_function(FileRecord &file, llvm::StringRef func_name,
+                                 const Json::Value &entry);
+  Json::Value     record_to_json(const CodeRecord &record) const;
+  Json::Value     records_to_json(const RecordMap &records) const;
+
+  // Definitions are copied into allocator_ by save(), which keeps the model
+  // movable, unlike a StringSaver that refers to the allocator.
+  llvm::BumpPtrAllocator                            allocator_;
+  llvm::StringMap<uint32_t, llvm::BumpPtrAllocator> string_ids_;
+  std::vector<llvm::StringRef>                      strings_;
+  llvm::SpecificBumpPtrAllocator<FileRecord>        file_allocator_;
+  llvm::SpecificBumpPtrAllocator<FunctionRecord>    function_allocator_;
+  llvm::DenseMap<uint32_t, FileRecord *>            files_;
+};
+
+#endif
\ No newline at end of file
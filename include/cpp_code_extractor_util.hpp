@@ -1,14 +1,48 @@
 #ifndef CPP_CODE_EXTRACTOR_UTIL_HPP
 #define CPP_CODE_EXTRACTOR_UTIL_HPP
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// Set of path prefixes, matched a whole path component at a time, so a lookup
+// costs O(path length) however many prefixes there are.
+class PathPrefixTrie {
+ public:
+  void insert(const std::string &prefix);
+  // Whether a prefix of path, in whole components, was inserted.
+  bool matches(const std::string &path) const;
+
+ private:
+  struct Node {
+    bool                                    is_prefix = false;
+    std::unordered_map<std::string, size_t> children;
+  };
+
+  static void for_each_component(
+      const std::string                              &path,
+      const std::function<bool(const std::string &)> &callback);
+
+  std::vector<Node> nodes_ = {Node()};
+};
+
 std::vector<std::string> get_compile_args(int argc, const char **argv);
-void add_system_include_paths(std::vector<std::string> &compile_args);
+void add_system_include_paths(std::vector<std::string> &compile_args,
+                              const std::string        &driver = "clang++");
 
 bool        is_system_file(const std::string &file_path);
 std::string get_canonical_abs_path(const std::string &file_path);
+std::string get_canonical_abs_path(const std::string &file_path,
+                                   const std::string &working_dir);
+// Number of get_canonical_abs_path() calls answered with and without a cached
+// realpath() result.
+size_t      get_canonical_path_cache_hits();
+size_t      get_canonical_path_cache_misses();
+// Forgets all realpath() results, e.g. between the queries of a long-running
+// server, where files may have been created, moved or deleted since.
+void        clear_canonical_path_cache();
 std::string strip(const std::string &str);
 bool        ends_with(const std::string &str, const std::string &suffix);
 
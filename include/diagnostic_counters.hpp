@@ -0,0 +1,59 @@
+#ifndef DIAGNOSTIC_COUNTERS_HPP
+#define DIAGNOSTIC_COUNTERS_HPP
+
+#include <jsoncpp/json/json.h>
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Calls that are not turned into call edges, by reason.
+enum class Diagnostic : uint32_t {
+  INDIRECT_CALL = 0,   // No direct callee, e.g. through a function pointer
+  DEPENDENT_CALL = 1,  // Resolved only when the template is instantiated
+  SYSTEM_CALLEE = 2,   // Callee declared in a system file
+};
+
+const char *get_diagnostic_name(Diagnostic diag);
+
+// Number of occurrences of each diagnostic, with the first few of each kind
+// kept as samples. Counting is a single increment, so the expression of a
+// diagnostic only needs to be printed when it is sampled.
+class DiagnosticCounters {
+ public:
+  static const size_t NUM_DIAGNOSTICS = 3;
+  static const size_t MAX_SAMPLES = 3;
+
+  // Counts one occurrence. Returns true if it should be described with
+  // add_sample().
+  bool count(Diagnostic diag) {
+    const size_t index = static_cast<size_t>(diag);
+    counts_[index]++;
+    return samples_[index].size() < MAX_SAMPLES;
+  }
+  void add_sample(Diagnostic diag, std::string sample);
+
+  // Adds the counts of other, and its samples while there is room.
+  void merge(const DiagnosticCounters &other);
+
+  uint64_t get_count(Diagnostic diag) const {
+    return counts_[static_cast<size_t>(diag)];
+  }
+
+  // One line per diagnostic that occurred, followed by its samples.
+  void print_summary(std::ostream &out) const;
+
+  // {"<name>": {"count": <count>, "samples": ["<sample>", ...]}, ...}
+  Json::Value to_json() const;
+  // Adds the counts and samples of json. Returns false if json is not in the
+  // layout of to_json().
+  bool from_json(const Json::Value &json);
+
+ private:
+  std::array<uint64_t, NUM_DIAGNOSTICS>                 counts_{};
+  std::array<std::vector<std::string>, NUM_DIAGNOSTICS> samples_;
+};
+
+#endif
\ No newline at end of file
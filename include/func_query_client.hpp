@@ -0,0 +1,33 @@
+#ifndef FUNC_QUERY_CLIENT_HPP
+#define FUNC_QUERY_CLIENT_HPP
+
+#include <string>
+#include <vector>
+
+// Environment variable with the Unix socket path of func_query_server.
+static const char *const FUNC_QUERY_SOCKET_ENV = "FUNC_QUERY_SOCKET";
+
+// A query to func_query_server. On the wire, a request is its fields in the
+// order below followed by the compile args, each terminated by '\0', and the
+// end of the request is marked by shutting down the sending side. A response
+// is "0\n" or "1\n", for success or failure, followed by the output.
+struct FuncQuery {
+  std::string              working_dir;
+  std::string              command;  // "list", "src" or "src_batch"
+  std::string              src_path;
+  std::string              func_name;  // One name per line for "src_batch"
+  std::vector<std::string> compile_args;
+};
+
+// Sends the query to the server named by $FUNC_QUERY_SOCKET and prints its
+// output to std::cout. Returns false if no server is set or reachable, in
+// which case the caller parses the source file itself.
+bool run_query_on_server(const FuncQuery &query, int &exit_code);
+
+std::string serialize_query(const FuncQuery &query);
+bool        deserialize_query(const std::string &data, FuncQuery &query);
+
+bool write_all(int fd, const std::string &data);
+bool read_all(int fd, std::string &data);
+
+#endif
\ No newline at end of file
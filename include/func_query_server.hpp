@@ -0,0 +1,60 @@
+#ifndef FUNC_QUERY_SERVER_HPP
+#define FUNC_QUERY_SERVER_HPP
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "clang/Frontend/ASTUnit.h"
+
+// Parsed translation units kept across queries, keyed by working directory,
+// source file and compile args. An entry is dropped when the modification
+// time of any file it read has changed, and the least recently used entries
+// are evicted once the estimated memory of all entries exceeds max_memory.
+class ASTCache {
+ public:
+  explicit ASTCache(size_t max_memory) : max_memory_(max_memory) {
+  }
+
+  // Returns the AST of the translation unit, parsing it if it is not cached
+  // or out of date. Returns nullptr and sets error if parsing failed. The
+  // current directory must be working_dir.
+  clang::ASTUnit *get(const std::string              &working_dir,
+                      const std::string              &src_path,
+                      const std::vector<std::string> &compile_args,
+                      std::string                    &error);
+
+  size_t get_num_hits() const {
+    return num_hits_;
+  }
+  size_t get_num_misses() const {
+    return num_misses_;
+  }
+  size_t get_memory() const {
+    return memory_;
+  }
+
+ private:
+  struct Entry {
+    std::string                                 key;
+    std::unique_ptr<clang::ASTUnit>             ast;
+    std::vector<std::pair<std::string, time_t>> files;
+    size_t                                      memory;
+  };
+
+  static bool is_up_to_date(const Entry &entry);
+  void        evict();
+
+  size_t                                                      max_memory_;
+  size_t                                                      memory_ = 0;
+  std::list<Entry>                                            entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  size_t                                                      num_hits_ = 0;
+  size_t                                                      num_misses_ = 0;
+};
+
+#endif
\ No newline at end of file
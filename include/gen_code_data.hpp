@@ -1,60 +1,202 @@
 #ifndef GEN_CODE_DATA_HPP
 #define GEN_CODE_DATA_HPP
 
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
-#include "clang/Analysis/CallGraph.h"
 #include "clang/Frontend/FrontendAction.h"
-#include "jsoncpp/json/json.h"
+#include "clang/Frontend/Utils.h"
+#include "code_model.hpp"
+#include "diagnostic_counters.hpp"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "symbol_index.hpp"
+#include "system_file_filter.hpp"
+
+// Headers whose declarations were already harvested by some translation unit,
+// keyed by canonical path, content hash and the hash of the configuration
+// (macros, include paths, ...) the header was compiled under. Macros defined
+// in the source before the #include are not part of the key, so a header
+// that depends on them is only harvested in the first context it is seen in.
+class HeaderRegistry {
+ public:
+  // Returns true if the header was not claimed before, in which case the
+  // caller is responsible for harvesting it.
+  bool claim(const std::string &file_path, uint64_t content_hash,
+             uint64_t config_hash);
+
+ private:
+  std::mutex                                            mutex_;
+  std::set<std::tuple<std::string, uint64_t, uint64_t>> headers_;
+};
+
+// Per translation unit view on a HeaderRegistry. Whether the declarations in a
+// file are harvested by this translation unit is decided once per FileID.
+class HeaderFilter {
+ public:
+  HeaderFilter(HeaderRegistry *registry, uint64_t config_hash,
+               const std::string &working_dir)
+      : registry_(registry),
+        config_hash_(config_hash),
+        working_dir_(working_dir) {
+  }
+
+  bool is_harvested_elsewhere(clang::SourceManager &src_manager,
+                              clang::SourceLocation loc);
+
+  // Whether the declarations of any header were left to another translation
+  // unit, i.e. whether the output of this translation unit is incomplete.
+  bool skipped_any() const;
+
+ private:
+  HeaderRegistry                     *registry_;
+  uint64_t                            config_hash_;
+  const std::string                  &working_dir_;
+  llvm::DenseMap<clang::FileID, bool> skipped_files_;
+  std::set<std::string>               claimed_files_;
+};
 
 class CodeDataVisitor : public clang::RecursiveASTVisitor<CodeDataVisitor> {
  public:
   explicit CodeDataVisitor(clang::SourceManager &src_manager,
                            clang::LangOptions   &lang_opts,
-                           Json::Value &output_json, clang::CallGraph &CG)
+                           CodeModel            &model,
+                           const std::string    &working_dir,
+                           llvm::raw_ostream    &log,
+                           SystemFileFilter     &system_filter,
+                           HeaderFilter         &header_filter,
+                           SymbolIndex          &symbols,
+                           DiagnosticCounters   &diagnostics,
+                           bool                  verbose)
       : src_manager_(src_manager),
         lang_opts_(lang_opts),
-        output_json_(output_json),
-        CG_(CG) {
+        model_(model),
+        working_dir_(working_dir),
+        log_(log),
+        system_filter_(system_filter),
+        header_filter_(header_filter),
+        symbols_(symbols),
+        diagnostics_(diagnostics),
+        verbose_(verbose) {
   }
 
+  bool TraverseDecl(clang::Decl *D);
+
   bool VisitFunctionDecl(clang::FunctionDecl *FuncDecl);
   bool VisitVarDecl(clang::VarDecl *VarDecl);
   bool VisitTypedefDecl(clang::TypedefDecl *TypedefDecl);
   bool VisitRecordDecl(clang::RecordDecl *RecordDecl);
   bool VisitEnumDecl(clang::EnumDecl *EnumDecl);
 
+  // Calls are collected in the same traversal, for the function definition
+  // being traversed.
+  bool VisitCallExpr(clang::CallExpr *CallExpr);
+  bool VisitCXXConstructExpr(clang::CXXConstructExpr *ConstructExpr);
+  bool VisitCXXNewExpr(clang::CXXNewExpr *NewExpr);
+  bool VisitCXXDeleteExpr(clang::CXXDeleteExpr *DeleteExpr);
+  bool VisitCXXBindTemporaryExpr(clang::CXXBindTemporaryExpr *BindExpr);
+
  private:
-  void construct_callgraph(clang::FunctionDecl *FuncDecl,
-                           Json::Value         &func_entry);
-  void add_callee(const std::string   &func_name,
-                  clang::FunctionDecl *callee_decl, Json::Value &caller_entry);
+  // The function definition whose body is being traversed. decl is null
+  // outside of function bodies, and in functions that are not extracted.
+  struct Caller {
+    clang::FunctionDecl *decl = nullptr;
+    std::string          file_path;
+    std::string          name;
+    SymbolID             id = 0;
+  };
+
+  void add_callee(const clang::FunctionDecl *callee_decl);
+  void add_destructor_callee(clang::QualType type);
+  void skip_call(Diagnostic                         diag,
+                 llvm::function_ref<std::string()> describe);
+  std::string describe_expr(const clang::Expr *expr);
 
   clang::SourceManager &src_manager_;
   clang::LangOptions   &lang_opts_;
-  Json::Value          &output_json_;
-  clang::CallGraph     &CG_;
+  CodeModel            &model_;
+  const std::string    &working_dir_;
+  llvm::raw_ostream    &log_;
+  SystemFileFilter     &system_filter_;
+  HeaderFilter         &header_filter_;
+  SymbolIndex          &symbols_;
+  DiagnosticCounters   &diagnostics_;
+  bool                  verbose_;
+  Caller                caller_;
 };
 
 class CodeDataASTConsumer : public clang::ASTConsumer {
  public:
   explicit CodeDataASTConsumer(clang::SourceManager &src_manager,
                                clang::LangOptions   &lang_opts,
-                               Json::Value          &output_json)
-      : Visitor(src_manager, lang_opts, output_json, CG_) {
+                               CodeModel            &model,
+                               const std::string    &working_dir,
+                               llvm::raw_ostream    &log,
+                               SystemFileFilter     &system_filter,
+                               HeaderFilter         &header_filter,
+                               SymbolIndex          &symbols,
+                               DiagnosticCounters   &diagnostics,
+                               bool                  verbose)
+      : Visitor(src_manager, lang_opts, model, working_dir, log, system_filter,
+                header_filter, symbols, diagnostics, verbose) {
   }
 
   void HandleTranslationUnit(clang::ASTContext &Context) override;
 
  private:
-  CodeDataVisitor  Visitor;
-  clang::CallGraph CG_;
+  CodeDataVisitor Visitor;
+};
+
+// Output partition of a single translation unit. Each worker fills its own
+// partition so that translation units can be processed side by side, and the
+// partitions are merged into the final output in compile command order.
+struct TUOutput {
+  // Files this translation unit harvested, read or called into. In exact
+  // disabled macros mode, the disabled macros of a file are only known if the
+  // translation unit preprocessed it.
+  CodeModel   model;
+  std::string log;
+
+  // Functions and calls of the translation unit, keyed by SymbolID.
+  SymbolIndex symbols;
+
+  // Calls that were not turned into call edges.
+  DiagnosticCounters diagnostics;
+
+  // Canonical paths of every file read while parsing the translation unit.
+  std::vector<std::string> dependencies;
+
+  // False if the output depends on other translation units or parsing failed.
+  bool cacheable = true;
+};
+
+// Records every file read by the preprocessor. System headers are included,
+// since a compiler upgrade changes them too.
+class AllDependencyCollector : public clang::DependencyCollector {
+ public:
+  bool needSystemDependencies() override {
+    return true;
+  }
 };
 
 class CodeDataFrontendAction : public clang::ASTFrontendAction {
  public:
-  CodeDataFrontendAction(Json::Value &output_json)
-      : output_json_(output_json) {};
+  CodeDataFrontendAction(TUOutput &tu_output, const std::string &working_dir,
+                         llvm::raw_ostream &log,
+                         HeaderRegistry *header_registry, uint64_t config_hash,
+                         bool exact_disabled_macros, bool verbose)
+      : tu_output_(tu_output),
+        working_dir_(working_dir),
+        log_(log),
+        header_filter_(header_registry, config_hash, working_dir),
+        exact_disabled_macros_(exact_disabled_macros),
+        verbose_(verbose) {};
 
   std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
       clang::CompilerInstance &CI, llvm::StringRef InFile) override;
@@ -62,33 +204,46 @@ class CodeDataFrontendAction : public clang::ASTFrontendAction {
   void ExecuteAction() override;
 
  private:
-  Json::Value &output_json_;
+  TUOutput                                  &tu_output_;
+  const std::string                         &working_dir_;
+  llvm::raw_ostream                         &log_;
+  std::unique_ptr<SystemFileFilter>          system_filter_;
+  HeaderFilter                               header_filter_;
+  std::shared_ptr<AllDependencyCollector>    dependency_collector_;
+  bool                                       exact_disabled_macros_;
+  bool                                       verbose_;
 };
 
 class MacroPrinter : public clang::PPCallbacks {
  public:
+  // With exact_disabled_macros, disabled macros are collected from the ranges
+  // skipped by the preprocessor, and every harvested file the preprocessor
+  // enters is marked as preprocessed in model.
   MacroPrinter(clang::SourceManager &SM, clang::LangOptions &LangOpts,
-               Json::Value &output_json);
+               CodeModel &model, const std::string &working_dir,
+               SystemFileFilter &system_filter, HeaderFilter &header_filter,
+               bool exact_disabled_macros);
 
   void MacroDefined(const clang::Token          &MacroNameTok,
                     const clang::MacroDirective *MD) override;
 
- private:
-  clang::SourceManager &src_manager_;
-  clang::LangOptions   &lang_opts_;
-  Json::Value          &output_json_;
-};
-
-class MacroAction : public clang::PreprocessorFrontendAction {
- public:
-  MacroAction(Json::Value &output_json);
-
-  void ExecuteAction() override;
+  void FileChanged(clang::SourceLocation                Loc,
+                   clang::PPCallbacks::FileChangeReason Reason,
+                   clang::SrcMgr::CharacteristicKind    FileType,
+                   clang::FileID PrevFID = clang::FileID()) override;
+  void SourceRangeSkipped(clang::SourceRange    Range,
+                          clang::SourceLocation EndifLoc) override;
 
  private:
-  void remove_enabled_macros();
+  std::string get_file_path(clang::SourceLocation loc);
 
-  Json::Value &output_json_;
+  clang::SourceManager &src_manager_;
+  clang::LangOptions   &lang_opts_;
+  CodeModel            &model_;
+  const std::string    &working_dir_;
+  SystemFileFilter     &system_filter_;
+  HeaderFilter         &header_filter_;
+  bool                  exact_disabled_macros_;
 };
 
 #endif
\ No newline at end of file
@@ -1,28 +1,38 @@
 #ifndef GET_FUNC_LIST_HPP
 #define GET_FUNC_LIST_HPP
 
+#include <ostream>
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "system_file_filter.hpp"
 
 class FunctionVisitor : public clang::RecursiveASTVisitor<FunctionVisitor> {
  public:
   explicit FunctionVisitor(clang::SourceManager &src_manager,
-                           llvm::StringRef       src_path)
-      : src_manager_(src_manager), src_path_(src_path) {
+                           llvm::StringRef src_path, std::ostream &out)
+      : src_manager_(src_manager),
+        src_path_(src_path),
+        out_(out),
+        system_filter_(src_manager) {
   }
+  bool TraverseDecl(clang::Decl *D);
   bool VisitFunctionDecl(clang::FunctionDecl *FuncDecl);
 
  private:
   clang::SourceManager &src_manager_;
   llvm::StringRef       src_path_;
+  std::ostream         &out_;
+  SystemFileFilter      system_filter_;
 };
 
 class FunctionASTConsumer : public clang::ASTConsumer {
  public:
   explicit FunctionASTConsumer(clang::SourceManager &src_manager,
-                               llvm::StringRef       src_path)
-      : Visitor(src_manager, src_path) {
+                               llvm::StringRef       src_path,
+                               std::ostream         &out)
+      : Visitor(src_manager, src_path, out) {
   }
 
   void HandleTranslationUnit(clang::ASTContext &Context) override;
@@ -33,7 +43,7 @@ class FunctionASTConsumer : public clang::ASTConsumer {
 
 class FunctionFrontendAction : public clang::ASTFrontendAction {
  public:
-  FunctionFrontendAction();
+  explicit FunctionFrontendAction(std::ostream &out);
 
   std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
       clang::CompilerInstance &CI, llvm::StringRef InFile) override;
@@ -41,6 +51,7 @@ class FunctionFrontendAction : public clang::ASTFrontendAction {
   void ExecuteAction() override;
 
  private:
+  std::ostream &out_;
 };
 
 #endif
\ No newline at end of file
@@ -1,31 +1,49 @@
 #ifndef GET_FUNC_SRC_HPP
 #define GET_FUNC_SRC_HPP
 
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "jsoncpp/json/json.h"
+#include "system_file_filter.hpp"
 
+// Collects the definitions of all target functions in one traversal. If
+// output_json is null, the source code of each definition is printed to out.
+// Otherwise every definition is appended to output_json[<func_name>] as
+// {"definition", "start_line", "end_line"}.
 class FuncSrcVisitor : public clang::RecursiveASTVisitor<FuncSrcVisitor> {
  public:
-  explicit FuncSrcVisitor(clang::SourceManager &src_manager,
-                          clang::LangOptions   &lang_opts,
-                          llvm::StringRef src_path, const char *target_func);
+  explicit FuncSrcVisitor(
+      clang::SourceManager &src_manager, const clang::LangOptions &lang_opts,
+      llvm::StringRef                        src_path,
+      const std::unordered_set<std::string> &target_funcs,
+      Json::Value *output_json, std::ostream &out);
 
+  bool TraverseDecl(clang::Decl *D);
   bool VisitFunctionDecl(clang::FunctionDecl *FuncDecl);
 
  private:
-  clang::SourceManager &src_manager_;
-  clang::LangOptions   &lang_opts_;
-  llvm::StringRef       src_path_;
-  const char           *target_func_;
+  clang::SourceManager                  &src_manager_;
+  const clang::LangOptions              &lang_opts_;
+  llvm::StringRef                        src_path_;
+  const std::unordered_set<std::string> &target_funcs_;
+  Json::Value                           *output_json_;
+  std::ostream                          &out_;
+  SystemFileFilter                       system_filter_;
 };
 
 class FuncSrcASTConsumer : public clang::ASTConsumer {
  public:
-  explicit FuncSrcASTConsumer(clang::SourceManager &src_manager,
-                              clang::LangOptions   &lang_opts,
-                              llvm::StringRef       src_path,
-                              const char           *target_func);
+  explicit FuncSrcASTConsumer(
+      clang::SourceManager &src_manager, clang::LangOptions &lang_opts,
+      llvm::StringRef                        src_path,
+      const std::unordered_set<std::string> &target_funcs,
+      Json::Value *output_json, std::ostream &out);
 
   void HandleTranslationUnit(clang::ASTContext &Context) override;
 
@@ -35,7 +53,8 @@ class FuncSrcASTConsumer : public clang::ASTConsumer {
 
 class FuncSrcFrontendAction : public clang::ASTFrontendAction {
  public:
-  FuncSrcFrontendAction(const char *target_func);
+  FuncSrcFrontendAction(const std::unordered_set<std::string> &target_funcs,
+                        Json::Value *output_json, std::ostream &out);
 
   std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(
       clang::CompilerInstance &CI, llvm::StringRef InFile) override;
@@ -43,7 +62,13 @@ class FuncSrcFrontendAction : public clang::ASTFrontendAction {
   void ExecuteAction() override;
 
  private:
-  const char *target_func_;
+  const std::unordered_set<std::string> &target_funcs_;
+  Json::Value                           *output_json_;
+  std::ostream                          &out_;
 };
 
+// Reads one function name per line. Surrounding whitespace and empty lines are
+// ignored.
+std::unordered_set<std::string> read_func_names(std::istream &in);
+
 #endif
\ No newline at end of file
@@ -11,5 +11,9 @@ void add_list(Json::Value &root, const std::vector<std::string> &keys,
               const Json::Value &value);
 
 bool contains_string(const Json::Value &array, const std::string &value);
+bool contains_value(const Json::Value &array, const Json::Value &value);
+
+void merge_json(Json::Value &dst, const Json::Value &src);
+void intersect_disabled_macros(Json::Value &dst, const Json::Value &src);
 
 #endif
\ No newline at end of file
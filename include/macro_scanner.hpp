@@ -0,0 +1,22 @@
+#ifndef MACRO_SCANNER_HPP
+#define MACRO_SCANNER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+struct MacroDefinitionLine {
+  std::string name;
+  std::string definition;  // Stripped lines joined by "\n"
+  int32_t     start_line;  // One less than the line of the #define
+  int32_t     end_line;
+};
+
+// Finds every line of the form `^\s*#\s*define\b` in buffer, along with its
+// continuation lines, without running the preprocessor. Lines are taken as
+// they are, so this also finds #defines in inactive regions and comments.
+std::vector<MacroDefinitionLine> scan_macro_definitions(llvm::StringRef buffer);
+
+#endif
\ No newline at end of file
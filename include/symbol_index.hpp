@@ -0,0 +1,96 @@
+#ifndef SYMBOL_INDEX_HPP
+#define SYMBOL_INDEX_HPP
+
+#include <jsoncpp/json/json.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+
+// Hash of the USR of a declaration. Redeclarations share their USR, while
+// overloads, methods of different classes and static functions of different
+// files each get their own.
+using SymbolID = uint64_t;
+
+// Never 0, nor one of the keys DenseMap reserves.
+SymbolID get_symbol_id(llvm::StringRef usr);
+
+// Functions keyed by SymbolID, with their names and definitions as
+// attributes, and the calls between them as (caller, callee) pairs. Unlike
+// the code data, which is keyed by plain names, symbols that share a name do
+// not overwrite each other, and every lookup is a single hash lookup.
+//
+// Calls are only appended while extracting. finalize() sorts them once and
+// builds the callees and callers of every symbol as compressed sparse rows,
+// i.e. one array of offsets and one array of symbols per direction.
+class SymbolIndex {
+ public:
+  struct Symbol {
+    llvm::StringRef name;
+    llvm::StringRef qualified_name;
+    llvm::StringRef file_path;  // Empty if no definition was seen
+    int32_t         start_line = 0;
+    int32_t         end_line = 0;
+  };
+
+  // A symbol with a definition replaces the one added before, and a symbol
+  // without one is only added if the id is new.
+  void add_symbol(SymbolID id, llvm::StringRef name,
+                  llvm::StringRef qualified_name,
+                  llvm::StringRef file_path = "", int32_t start_line = 0,
+                  int32_t end_line = 0);
+  void add_call(SymbolID caller, SymbolID callee);
+  // Adds the symbols and calls of other, as if they were added one by one.
+  void merge(const SymbolIndex &other);
+  // Sorts and deduplicates the calls, in parallel if there are enough, and
+  // rebuilds the arrays returned by get_callees() and get_callers().
+  void finalize();
+
+  const Symbol            *find(SymbolID id) const;
+  llvm::ArrayRef<SymbolID> find_by_name(llvm::StringRef name) const;
+  // Sorted by SymbolID, as of the last finalize().
+  llvm::ArrayRef<SymbolID> get_callees(SymbolID id) const;
+  llvm::ArrayRef<SymbolID> get_callers(SymbolID id) const;
+
+  size_t get_num_symbols() const {
+    return symbols_.size();
+  }
+  size_t get_num_calls() const {
+    return calls_.size();
+  }
+
+  // {"symbols": {"<id>": {...}}, "calls": [["<caller>", "<callee>"], ...]},
+  // with ids as hexadecimal strings. Calls are sorted if finalized.
+  Json::Value to_json() const;
+  // Adds the symbols and calls of json and finalizes. Returns false if json is
+  // not in the layout of to_json().
+  bool from_json(const Json::Value &json);
+
+ private:
+  // Adjacency of the symbols in node_index_, in compressed sparse row form:
+  // the neighbors of node i are targets[offsets[i]] to targets[offsets[i+1]].
+  struct Adjacency {
+    std::vector<uint32_t> offsets;
+    std::vector<SymbolID> targets;
+  };
+
+  llvm::StringRef          intern(llvm::StringRef str);
+  llvm::ArrayRef<SymbolID> get_neighbors(const Adjacency &adjacency,
+                                         SymbolID         id) const;
+
+  llvm::StringSet<>                               strings_;
+  llvm::DenseMap<SymbolID, Symbol>                symbols_;
+  llvm::StringMap<llvm::SmallVector<SymbolID, 1>> names_;
+  std::vector<std::pair<SymbolID, SymbolID>>      calls_;
+  llvm::DenseMap<SymbolID, uint32_t>              node_index_;
+  Adjacency                                       callees_;
+  Adjacency                                       callers_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef SYSTEM_FILE_FILTER_HPP
+#define SYSTEM_FILE_FILTER_HPP
+
+#include <string>
+
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+
+// Classifies the files of one translation unit as system or user files. The
+// answer is computed once per FileID, so visitors can skip whole subtrees of
+// declarations in system headers before descending into them.
+class SystemFileFilter {
+ public:
+  explicit SystemFileFilter(clang::SourceManager &src_manager,
+                            const std::string    &working_dir = "");
+
+  bool is_system_loc(clang::SourceLocation loc);
+
+ private:
+  clang::SourceManager               &src_manager_;
+  const std::string                   working_dir_;
+  llvm::DenseMap<clang::FileID, bool> system_files_;
+};
+
+#endif
\ No newline at end of file
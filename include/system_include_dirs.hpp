@@ -0,0 +1,20 @@
+#ifndef SYSTEM_INCLUDE_DIRS_HPP
+#define SYSTEM_INCLUDE_DIRS_HPP
+
+#include <string>
+#include <vector>
+
+// Driver whose system include directories are used for a translation unit:
+// "clang" for C sources and "clang++" otherwise. An explicit "-x <language>"
+// in args takes precedence over the extension of src_path.
+std::string get_driver_for_source(const std::string              &src_path,
+                                  const std::vector<std::string> &args);
+
+// The system include directories of the given driver, in search order. They
+// are computed in-process with the clang driver, and fall back to running
+// "<driver> -E -v" if that fails. Results are cached on disk, keyed by the
+// identity of the driver binary, and in memory for the rest of the process.
+const std::vector<std::string> &get_system_include_dirs(
+    const std::string &driver);
+
+#endif
\ No newline at end of file
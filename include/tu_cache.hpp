@@ -0,0 +1,52 @@
+#ifndef TU_CACHE_HPP
+#define TU_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "CompileCommand.hpp"
+#include "gen_code_data.hpp"
+
+// On-disk cache of the output of translation units. An entry is keyed by the
+// source file, its working directory and its compile arguments, and it records
+// the content hash of every file the translation unit read. An entry is only
+// used while all of those files are unchanged.
+class TUCache {
+ public:
+  // Entries written with different extraction options are kept apart.
+  TUCache(const std::string &cache_dir, const std::string &options = "");
+
+  // Fill tu_output from the cache. Returns false, leaving tu_output untouched,
+  // if there is no valid entry for the translation unit.
+  bool load(const CompileCommand &cmd, const std::string &src_code,
+            TUOutput &tu_output);
+  void store(const CompileCommand &cmd, const std::string &src_code,
+             const TUOutput &tu_output);
+
+  // Content hash of a file. It is computed once per run, and false is
+  // returned if the file cannot be read.
+  bool get_file_hash(const std::string &file_path, uint64_t &hash);
+
+  size_t get_num_hits() const {
+    return num_hits_;
+  }
+  size_t get_num_misses() const {
+    return num_misses_;
+  }
+
+ private:
+  std::string get_entry_path(const CompileCommand &cmd,
+                             const std::string    &src_code) const;
+
+  std::string                               cache_dir_;
+  std::string                               options_;
+  std::mutex                                file_hashes_mutex_;
+  std::unordered_map<std::string, uint64_t> file_hashes_;
+  std::atomic<size_t>                       num_hits_{0};
+  std::atomic<size_t>                       num_misses_{0};
+};
+
+#endif
\ No newline at end of file
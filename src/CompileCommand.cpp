@@ -0,0 +1,462 @@
+#include "CompileCommand.hpp"
+
+#include <jsoncpp/json/json.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <unordered_set>
+
+#include "cpp_code_extractor_util.hpp"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "system_include_dirs.hpp"
+
+// Response files may refer to other response files, but not endlessly.
+static const uint32_t MAX_RESPONSE_FILE_DEPTH = 16;
+
+CompileCommand::CompileCommand() {
+}
+
+static std::string get_abs_path(const std::string &path,
+                                const std::string &working_dir) {
+  if (path.empty() || path[0] == '/') { return path; }
+  return working_dir + "/" + path;
+}
+
+// Replaces each "@<file>" argument with the arguments in the file. Like the
+// compiler driver, an argument naming a file that cannot be read is kept.
+static void expand_response_files(std::vector<std::string> &args,
+                                  const std::string        &working_dir,
+                                  uint32_t                  depth = 0) {
+  std::vector<std::string> expanded;
+
+  for (std::string &arg : args) {
+    if (arg.size() < 2 || arg[0] != '@' || depth >= MAX_RESPONSE_FILE_DEPTH) {
+      expanded.push_back(std::move(arg));
+      continue;
+    }
+
+    auto buffer = llvm::MemoryBuffer::getFile(
+        get_abs_path(arg.substr(1), working_dir), /*IsText=*/true);
+    if (!buffer) {
+      expanded.push_back(std::move(arg));
+      continue;
+    }
+
+    std::vector<std::string> file_args =
+        tokenize_command((*buffer)->getBuffer().str());
+    expand_response_files(file_args, working_dir, depth + 1);
+    for (std::string &file_arg : file_args) {
+      expanded.push_back(std::move(file_arg));
+    }
+  }
+
+  args.swap(expanded);
+}
+
+// Index of the source file in args. If src_file is empty, it is the first
+// argument with a C or C++ source extension.
+static size_t find_src_index(const std::vector<std::string> &args,
+                             const std::string              &working_dir,
+                             const std::string              &src_file) {
+  static const std::set<std::string> src_extensions = {".c", ".cc", ".cpp",
+                                                       ".cxx"};
+
+  const size_t num_tokens = args.size();
+  if (!src_file.empty()) {
+    for (size_t index = 0; index < num_tokens; index++) {
+      if (args[index] == src_file ||
+          get_abs_path(args[index], working_dir) == src_file) {
+        return index;
+      }
+    }
+  }
+
+  for (size_t index = 0; index < num_tokens; index++) {
+    for (const std::string &ext : src_extensions) {
+      if (ends_with(args[index], ext)) { return index; }
+    }
+  }
+
+  return -1;
+}
+
+// Turns the compiler arguments, without the compiler itself, into a command
+// for the extractor. Returns false if the command is to be skipped.
+static bool make_compile_command(const std::string           &working_dir,
+                                 std::vector<std::string>     args,
+                                 const std::string           &src_file,
+                                 const std::set<std::string> &excludes,
+                                 CompileCommand              &command) {
+  if (working_dir.find("TryCompile") != std::string::npos) { return false; }
+
+  expand_response_files(args, working_dir);
+  if (args.size() == 0) { return false; }
+
+  const size_t src_index = find_src_index(args, working_dir, src_file);
+  if (src_index == static_cast<size_t>(-1)) { return false; }
+
+  std::string src_path = args[src_index];
+
+  if (src_path.find("conftest") != std::string::npos) { return false; }
+  if (src_path.find("CMakeC") != std::string::npos) { return false; }
+
+  for (const std::string &excl : excludes) {
+    if (src_path.find(excl) != std::string::npos) { return false; }
+  }
+
+  args.erase(args.begin() + src_index);
+
+  auto c_index = std::find(args.begin(), args.end(), "-c");
+  if (c_index != args.end()) { args.erase(c_index); }
+
+  add_system_include_paths(args, get_driver_for_source(src_path, args));
+
+  command =
+      CompileCommand(working_dir, args, get_abs_path(src_path, working_dir));
+  return true;
+}
+
+// Prefix of the lines cc_wrapper and cxx_wrapper quote with shlex.join().
+static const llvm::StringRef QUOTED_LINE_PREFIX = "shlex: ";
+
+// The arguments of a line of older wrappers, which joined them with plain
+// spaces. Quotes in such a line are part of the arguments, e.g.
+// -DVERSION="1.2" defines a string literal, so it is split on spaces only.
+static std::vector<std::string> split_legacy_line(llvm::StringRef line) {
+  llvm::SmallVector<llvm::StringRef, 32> parts;
+  line.split(parts, ' ');
+
+  std::vector<std::string> tokens;
+  tokens.reserve(parts.size());
+  for (llvm::StringRef part : parts) { tokens.push_back(part.str()); }
+  return tokens;
+}
+
+// "<working_dir> <compile args> ..." per line, as written by cc_wrapper and
+// cxx_wrapper. Lines with QUOTED_LINE_PREFIX are split like a shell does, and
+// the lines of older wrappers on spaces, as they always were.
+static void read_command_lines(llvm::StringRef              content,
+                               const std::set<std::string> &excludes,
+                               std::vector<CompileCommand> &commands) {
+  while (!content.empty()) {
+    auto [line, rest] = content.split('\n');
+    content = rest;
+
+    if (line.empty()) { continue; }
+    if (line.find("-c") == llvm::StringRef::npos) { continue; }
+
+    std::vector<std::string> tokens =
+        line.consume_front(QUOTED_LINE_PREFIX)
+            ? tokenize_command(line.str())
+            : split_legacy_line(line);
+    if (tokens.size() < 2) { continue; }
+
+    const std::string        working_dir = tokens[0];
+    std::vector<std::string> args(tokens.begin() + 1, tokens.end());
+
+    CompileCommand command;
+    if (make_compile_command(working_dir, std::move(args), "", excludes,
+                             command)) {
+      commands.push_back(std::move(command));
+    }
+  }
+}
+
+static size_t skip_whitespace(llvm::StringRef text, size_t pos) {
+  while (pos < text.size() && strchr(" \t\r\n", text[pos]) != nullptr) {
+    pos++;
+  }
+  return pos;
+}
+
+// Calls callback with the text of each element of the top-level JSON array of
+// objects in text. Only the element at hand is parsed, so that a database of
+// hundreds of MB is never held as one JSON value. Returns false if text is
+// not an array of objects.
+static bool for_each_array_element(
+    llvm::StringRef                             text,
+    const std::function<void(llvm::StringRef)> &callback) {
+  size_t pos = skip_whitespace(text, 0);
+  if (pos >= text.size() || text[pos] != '[') { return false; }
+  pos = skip_whitespace(text, pos + 1);
+  if (pos < text.size() && text[pos] == ']') { return true; }
+
+  while (pos < text.size()) {
+    if (text[pos] != '{') { return false; }
+
+    // Find the matching '}', skipping over strings.
+    const size_t start = pos;
+    size_t       depth = 0;
+    bool         in_string = false;
+    for (; pos < text.size(); pos++) {
+      const char c = text[pos];
+      if (in_string) {
+        if (c == '\\') {
+          pos++;
+        } else if (c == '"') {
+          in_string = false;
+        }
+      } else if (c == '"') {
+        in_string = true;
+      } else if (c == '{' || c == '[') {
+        depth++;
+      } else if ((c == '}' || c == ']') && --depth == 0) {
+        break;
+      }
+    }
+    if (pos >= text.size()) { return false; }
+
+    callback(text.slice(start, pos + 1));
+
+    pos = skip_whitespace(text, pos + 1);
+    if (pos >= text.size()) { return false; }
+    if (text[pos] == ']') { return true; }
+    if (text[pos] != ',') { return false; }
+    pos = skip_whitespace(text, pos + 1);
+  }
+
+  return false;
+}
+
+// The JSON compilation database format: an array of objects with
+// "directory", "file" and either "arguments" or a shell-quoted "command".
+static bool read_compile_commands_json(llvm::StringRef              content,
+                                       const std::set<std::string> &excludes,
+                                       std::vector<CompileCommand> &commands) {
+  Json::CharReaderBuilder           reader_builder;
+  std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+  size_t                            num_invalid = 0;
+
+  const bool success =
+      for_each_array_element(content, [&](llvm::StringRef element) {
+        Json::Value entry;
+        std::string errors;
+        if (!reader->parse(element.begin(), element.end(), &entry, &errors) ||
+            !entry["directory"].isString() || !entry["file"].isString()) {
+          num_invalid++;
+          return;
+        }
+
+        std::vector<std::string> args;
+        if (entry["arguments"].isArray()) {
+          for (const Json::Value &arg : entry["arguments"]) {
+            args.push_back(arg.asString());
+          }
+        } else if (entry["command"].isString()) {
+          args = tokenize_command(entry["command"].asString());
+        }
+
+        // The first argument is the compiler itself.
+        if (args.size() < 2) {
+          num_invalid++;
+          return;
+        }
+        args.erase(args.begin());
+
+        const std::string working_dir = entry["directory"].asString();
+        const std::string src_file =
+            get_abs_path(entry["file"].asString(), working_dir);
+
+        CompileCommand command;
+        if (make_compile_command(working_dir, std::move(args), src_file,
+                                 excludes, command)) {
+          commands.push_back(std::move(command));
+        }
+      });
+
+  if (num_invalid > 0) {
+    std::cerr << "Warning: skipped " << num_invalid
+              << " invalid compile_commands.json entries\n";
+  }
+  return success;
+}
+
+std::vector<CompileCommand> read_compile_commands(
+    const char *compile_commands_path, const std::set<std::string> &excludes) {
+  std::vector<CompileCommand> commands{};
+
+  // Large databases are mapped instead of read.
+  auto buffer = llvm::MemoryBuffer::getFile(compile_commands_path,
+                                            /*IsText=*/false,
+                                            /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    std::cerr << "Error: could not open compile commands file "
+              << compile_commands_path << "\n";
+    return {};
+  }
+
+  const llvm::StringRef content = (*buffer)->getBuffer();
+  const size_t          first = skip_whitespace(content, 0);
+
+  if (first < content.size() && content[first] == '[') {
+    if (!read_compile_commands_json(content, excludes, commands)) {
+      std::cerr << "Error: " << compile_commands_path
+                << " is not a valid compile_commands.json\n";
+    }
+    return commands;
+  }
+
+  read_command_lines(content, excludes, commands);
+  return commands;
+}
+
+// Options followed by a separate value that must stay attached to it.
+static const std::set<std::string> ARGS_WITH_VALUE = {
+    "-D", "-U", "-I", "-include", "-imacros", "-isystem", "-iquote",
+    "-idirafter", "-isysroot", "--sysroot", "-iprefix", "-iwithprefix", "-x",
+    "-target", "-arch", "-Xclang", "-Xpreprocessor"};
+
+// Options that only affect outputs, dependency files, diagnostics or code
+// generation, and not the AST. Position independent code is kept, since it
+// defines __PIC__ and __PIE__, which the source may test.
+static const std::set<std::string> IGNORED_ARGS_WITH_VALUE = {"-o", "-MF",
+                                                              "-MT", "-MQ"};
+static const std::set<std::string> IGNORED_ARGS = {
+    "-MD", "-MMD", "-MP", "-pipe", "-w", "-ffunction-sections",
+    "-fdata-sections", "-fcolor-diagnostics", "-fno-color-diagnostics"};
+
+// Debug info flags. They are matched by name rather than by the -g prefix,
+// which driver options such as -gcc-toolchain <dir> share.
+static const std::set<std::string> DEBUG_ARGS = {
+    "-g", "-g0", "-g1", "-g2", "-g3", "-gbtf", "-gcodeview", "-gcodeview-ghash",
+    "-gcolumn-info", "-gembed-source", "-gfull", "-ggnu-pubnames",
+    "-ginline-line-tables", "-gline-directives-only", "-gline-tables-only",
+    "-glldb", "-gmodules", "-gpubnames", "-grecord-command-line",
+    "-grecord-gcc-switches", "-gsce", "-gsplit-dwarf", "-gstrict-dwarf",
+    "-gused", "-gz"};
+// Debug info flags with a version, level or value, e.g. -gdwarf-4, -ggdb3,
+// -gz=zlib, and the negated ones, e.g. -gno-column-info.
+static const char *const DEBUG_ARG_PREFIXES[] = {
+    "-gdwarf", "-ggdb", "-gstabs", "-gxcoff", "-gvms", "-gz=", "-gsplit-dwarf=",
+    "-gsimple-template-names", "-gno-"};
+
+// -f flags with different names that override each other, mapped to one
+// family. The last one wins, so their order matters.
+static const std::map<std::string, std::string> EXCLUSIVE_FLAG_FAMILIES = {
+    {"-fpic", "-fpic"},
+    {"-fPIC", "-fpic"},
+    {"-fpie", "-fpic"},
+    {"-fPIE", "-fpic"},
+    {"-fsigned-char", "-fsigned-char"},
+    {"-funsigned-char", "-fsigned-char"},
+    {"-fsigned-bitfields", "-fsigned-bitfields"},
+    {"-funsigned-bitfields", "-fsigned-bitfields"},
+    {"-fwrapv", "-fwrapv"},
+    {"-ftrapv", "-fwrapv"}};
+
+static bool starts_with(const std::string &str, const char *prefix) {
+  return str.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static bool is_ignored_arg(const std::string &arg) {
+  if (IGNORED_ARGS.find(arg) != IGNORED_ARGS.end()) { return true; }
+
+  // Joined values, e.g. "-ofoo.o" or "-MFfoo.d"
+  for (const std::string &option : IGNORED_ARGS_WITH_VALUE) {
+    if (arg.size() > option.size() && starts_with(arg, option.c_str())) {
+      return true;
+    }
+  }
+
+  // Warnings, but not -Wp, and -Wa, which pass options on
+  if (starts_with(arg, "-W")) {
+    return !starts_with(arg, "-Wp,") && !starts_with(arg, "-Wa,");
+  }
+
+  if (DEBUG_ARGS.find(arg) != DEBUG_ARGS.end()) { return true; }
+  for (const char *prefix : DEBUG_ARG_PREFIXES) {
+    if (starts_with(arg, prefix)) { return true; }
+  }
+  return false;
+}
+
+// Flags whose position does not matter, as long as no other flag of the same
+// family, e.g. "-fexceptions" and "-fno-exceptions", overrides them. -m flags
+// keep their position, since too many of them override each other under
+// different names, e.g. -m32 and -m64.
+static bool get_flag_family(const std::string &arg, std::string &family) {
+  if (!starts_with(arg, "-f") && !starts_with(arg, "-std=")) { return false; }
+
+  family = arg.substr(0, arg.find('='));
+  if (family.compare(2, 3, "no-") == 0) { family.erase(2, 3); }
+
+  auto exclusive = EXCLUSIVE_FLAG_FAMILIES.find(family);
+  if (exclusive != EXCLUSIVE_FLAG_FAMILIES.end()) {
+    family = exclusive->second;
+  }
+  return true;
+}
+
+std::vector<std::string> normalize_compile_args(
+    const std::vector<std::string> &args) {
+  std::vector<std::string> kept;
+  std::vector<std::string> ordered;
+  std::vector<std::string> flags;
+  std::set<std::string>    families;
+  bool                     sortable = true;
+
+  for (size_t idx = 0; idx < args.size(); idx++) {
+    const std::string &arg = args[idx];
+
+    if (IGNORED_ARGS_WITH_VALUE.find(arg) != IGNORED_ARGS_WITH_VALUE.end()) {
+      idx++;
+      continue;
+    }
+    if (is_ignored_arg(arg)) { continue; }
+
+    kept.push_back(arg);
+
+    if (ARGS_WITH_VALUE.find(arg) != ARGS_WITH_VALUE.end() &&
+        idx + 1 < args.size()) {
+      kept.push_back(args[++idx]);
+      ordered.push_back(arg);
+      ordered.push_back(args[idx]);
+      continue;
+    }
+
+    std::string family;
+    if (get_flag_family(arg, family)) {
+      if (!families.insert(family).second) { sortable = false; }
+      flags.push_back(arg);
+      continue;
+    }
+
+    ordered.push_back(arg);
+  }
+
+  if (!sortable) { return kept; }
+
+  std::sort(flags.begin(), flags.end());
+  ordered.insert(ordered.end(), flags.begin(), flags.end());
+  return ordered;
+}
+
+std::vector<CompileCommand> plan_compile_commands(
+    const std::vector<CompileCommand> &commands, bool one_config_per_file) {
+  std::vector<CompileCommand>     planned;
+  std::unordered_set<std::string> planned_keys;
+
+  for (const CompileCommand &command : commands) {
+    std::string key = command.src_file_;
+    if (!one_config_per_file) {
+      key += '\0';
+      key += command.working_dir_;
+      for (const std::string &arg : normalize_compile_args(command.command_)) {
+        key += '\0';
+        key += arg;
+      }
+    }
+
+    if (!planned_keys.insert(std::move(key)).second) { continue; }
+    planned.push_back(command);
+  }
+
+  return planned;
+}
\ No newline at end of file
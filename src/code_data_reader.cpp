@@ -0,0 +1,140 @@
+#include "code_data_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Whether [offset, offset + num * size) lies within a buffer of buffer_size
+// bytes, without overflowing.
+static bool is_in_bounds(uint64_t offset, uint64_t num, uint64_t size,
+                         uint64_t buffer_size) {
+  if (offset > buffer_size) { return false; }
+  return num <= (buffer_size - offset) / size;
+}
+
+bool CodeDataReader::open(const std::string &file_path) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(file_path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    std::cerr << "Error: could not read " << file_path << ": "
+              << buffer.getError().message() << "\n";
+    return false;
+  }
+
+  const char    *data = (*buffer)->getBufferStart();
+  const uint64_t size = (*buffer)->getBufferSize();
+
+  CodeDataHeader header;
+  if (size < sizeof(header)) {
+    std::cerr << "Error: " << file_path << " is not a code data file\n";
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, CODE_DATA_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != CODE_DATA_VERSION) {
+    std::cerr << "Error: " << file_path << " is not a code data file\n";
+    return false;
+  }
+
+  if (!is_in_bounds(header.string_offsets_offset, header.num_strings + 1,
+                    sizeof(uint64_t), size) ||
+      !is_in_bounds(header.string_data_offset, header.string_data_size, 1,
+                    size) ||
+      !is_in_bounds(header.records_offset, header.num_records,
+                    sizeof(CodeDataRecord), size) ||
+      !is_in_bounds(header.edges_offset, header.num_edges, sizeof(uint32_t),
+                    size) ||
+      header.string_offsets_offset % alignof(uint64_t) != 0 ||
+      header.records_offset % alignof(CodeDataRecord) != 0 ||
+      header.edges_offset % alignof(uint32_t) != 0) {
+    std::cerr << "Error: " << file_path << " is truncated or corrupted\n";
+    return false;
+  }
+
+  const llvm::ArrayRef<uint64_t> string_offsets(
+      reinterpret_cast<const uint64_t *>(data + header.string_offsets_offset),
+      header.num_strings + 1);
+  // get_string() relies on every string lying within the string data.
+  if (!std::is_sorted(string_offsets.begin(), string_offsets.end()) ||
+      string_offsets.back() > header.string_data_size) {
+    std::cerr << "Error: " << file_path << " is truncated or corrupted\n";
+    return false;
+  }
+
+  buffer_ = std::move(*buffer);
+  string_offsets_ = string_offsets;
+  string_data_ = data + header.string_data_offset;
+  records_ = llvm::ArrayRef<CodeDataRecord>(
+      reinterpret_cast<const CodeDataRecord *>(data + header.records_offset),
+      header.num_records);
+  edges_ = llvm::ArrayRef<uint32_t>(
+      reinterpret_cast<const uint32_t *>(data + header.edges_offset),
+      header.num_edges);
+  return true;
+}
+
+llvm::StringRef CodeDataReader::get_string(uint32_t id) const {
+  if (static_cast<size_t>(id) + 1 >= string_offsets_.size()) {
+    return llvm::StringRef();
+  }
+  const uint64_t begin = string_offsets_[id];
+  const uint64_t end = string_offsets_[id + 1];
+  if (begin >= end) { return llvm::StringRef(); }
+  // Drop the NUL terminator.
+  return llvm::StringRef(string_data_ + begin, end - begin - 1);
+}
+
+llvm::ArrayRef<CodeDataRecord> CodeDataReader::find(
+    CodeDataKind kind, llvm::StringRef name) const {
+  auto less = [this](const CodeDataRecord &record,
+                     const std::pair<CodeDataKind, llvm::StringRef> &key) {
+    if (record.kind != key.first) { return record.kind < key.first; }
+    return get_string(record.name) < key.second;
+  };
+  auto greater = [this](const std::pair<CodeDataKind, llvm::StringRef> &key,
+                        const CodeDataRecord &record) {
+    if (record.kind != key.first) { return key.first < record.kind; }
+    return key.second < get_string(record.name);
+  };
+
+  const auto key = std::make_pair(kind, name);
+  const auto begin =
+      std::lower_bound(records_.begin(), records_.end(), key, less);
+  const auto end = std::upper_bound(begin, records_.end(), key, greater);
+  return llvm::ArrayRef<CodeDataRecord>(begin, end);
+}
+
+const CodeDataRecord *CodeDataReader::find(CodeDataKind    kind,
+                                           llvm::StringRef name,
+                                           llvm::StringRef file_path) const {
+  llvm::ArrayRef<CodeDataRecord> records = find(kind, name);
+  const auto                     found = std::lower_bound(
+      records.begin(), records.end(), file_path,
+      [this](const CodeDataRecord &record, llvm::StringRef file_path) {
+        return get_string(record.file) < file_path;
+      });
+  if (found == records.end() || get_string(found->file) != file_path) {
+    return nullptr;
+  }
+  return found;
+}
+
+llvm::ArrayRef<uint32_t> CodeDataReader::get_callees(
+    const CodeDataRecord &record) const {
+  if (record.callees_offset > edges_.size() ||
+      record.num_callees > edges_.size() - record.callees_offset) {
+    return {};
+  }
+  return edges_.slice(record.callees_offset, record.num_callees);
+}
+
+llvm::ArrayRef<uint32_t> CodeDataReader::get_callers(
+    const CodeDataRecord &record) const {
+  if (record.callers_offset > edges_.size() ||
+      record.num_callers > edges_.size() - record.callers_offset) {
+    return {};
+  }
+  return edges_.slice(record.callers_offset, record.num_callers);
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "code_data_writer.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+
+CodeDataWriter::CodeDataWriter(std::ostream &out, OutputFormat format,
+                               bool compact)
+    : out_(out), format_(format), compact_(compact) {
+  Json::StreamWriterBuilder builder;
+  // JSON Lines needs one record per line.
+  if (compact_ || format_ == OutputFormat::JSONL) {
+    builder["indentation"] = "";
+  }
+  writer_.reset(builder.newStreamWriter());
+}
+
+std::string CodeDataWriter::to_string(const Json::Value &value) const {
+  std::ostringstream stream;
+  writer_->write(value, &stream);
+  return stream.str();
+}
+
+void CodeDataWriter::write_file_entry(const std::string &file_path,
+                                      const Json::Value &file_entry) {
+  const std::string key = to_string(Json::Value(file_path));
+  const std::string value = to_string(file_entry);
+
+  if (format_ == OutputFormat::JSONL) {
+    out_ << "{" << key << ":" << value << "}\n";
+    num_entries_++;
+    return;
+  }
+
+  if (compact_) {
+    out_ << (num_entries_ == 0 ? "{" : ",") << key << ":" << value;
+    num_entries_++;
+    return;
+  }
+
+  // Reproduce the layout of the styled writer: every line of the entry is
+  // indented by one more level, and non-empty objects and arrays start on a
+  // line of their own.
+  out_ << (num_entries_ == 0 ? "{" : ",") << "\n\t" << key << " : ";
+
+  const bool is_multiline = value.find('\n') != std::string::npos;
+  if (is_multiline) { out_ << "\n\t"; }
+
+  size_t line_start = 0;
+  size_t newline_pos = value.find('\n');
+  while (newline_pos != std::string::npos) {
+    out_.write(value.data() + line_start, newline_pos - line_start + 1);
+    out_ << '\t';
+    line_start = newline_pos + 1;
+    newline_pos = value.find('\n', line_start);
+  }
+  out_.write(value.data() + line_start, value.size() - line_start);
+
+  num_entries_++;
+  return;
+}
+
+void CodeDataWriter::finish() {
+  if (format_ == OutputFormat::JSONL) { return; }
+
+  if (num_entries_ == 0) {
+    // An empty output used to be a null value.
+    out_ << (compact_ ? "null" : "null\n");
+    return;
+  }
+
+  out_ << (compact_ ? "}" : "\n}\n");
+  return;
+}
+
+BinaryCodeDataWriter::BinaryCodeDataWriter(std::ostream &out) : out_(out) {
+}
+
+uint32_t BinaryCodeDataWriter::intern(llvm::StringRef str) {
+  auto inserted = string_ids_.try_emplace(str, strings_.size());
+  if (inserted.second) { strings_.push_back(inserted.first->getKey()); }
+  return inserted.first->getValue();
+}
+
+uint64_t BinaryCodeDataWriter::add_edges(const Json::Value &names) {
+  const uint64_t offset = edges_.size();
+  for (const Json::Value &name : names) {
+    edges_.push_back(intern(name.asString()));
+  }
+  return offset;
+}
+
+void BinaryCodeDataWriter::add_record(CodeDataKind kind, uint32_t file,
+                                      uint32_t           parent,
+                                      const std::string &name,
+                                      const Json::Value &entry) {
+  CodeDataRecord record = {};
+  record.kind = kind;
+  record.file = file;
+  record.name = intern(name);
+  record.parent = parent;
+  record.definition = intern(entry["definition"].asString());
+  record.start_line = entry["start_line"].asUInt();
+  record.end_line = entry["end_line"].asUInt();
+  record.num_callees = entry["callees"].size();
+  record.callees_offset = add_edges(entry["callees"]);
+  record.num_callers = entry["callers"].size();
+  record.callers_offset = add_edges(entry["callers"]);
+  records_.push_back(record);
+  return;
+}
+
+void BinaryCodeDataWriter::write_file_entry(const std::string &file_path,
+                                            const Json::Value &file_entry) {
+  static const std::pair<const char *, CodeDataKind> sections[] = {
+      {"functions", CodeDataKind::FUNCTION},
+      {"global_variables", CodeDataKind::GLOBAL_VARIABLE},
+      {"types", CodeDataKind::TYPE},
+      {"enums", CodeDataKind::ENUM},
+      {"macros", CodeDataKind::MACRO},
+      {"disabled_macros", CodeDataKind::DISABLED_MACRO},
+  };
+
+  const uint32_t file = intern(file_path);
+
+  for (const auto &section : sections) {
+    const Json::Value &entries = file_entry[section.first];
+    if (!entries.isObject()) { continue; }
+
+    for (const std::string &name : entries.getMemberNames()) {
+      const Json::Value &entry = entries[name];
+
+      // A disabled macro has one definition per #define that was skipped.
+      if (entry.isArray()) {
+        for (const Json::Value &def : entry) {
+          add_record(section.second, file, CODE_DATA_NO_STRING, name, def);
+        }
+        continue;
+      }
+      add_record(section.second, file, CODE_DATA_NO_STRING, name, entry);
+
+      if (section.second != CodeDataKind::FUNCTION) { continue; }
+
+      const Json::Value &variables = entry["variables"];
+      if (!variables.isObject()) { continue; }
+
+      const uint32_t func_name = intern(name);
+      for (const std::string &var_name : variables.getMemberNames()) {
+        add_record(CodeDataKind::VARIABLE, file, func_name, var_name,
+                   variables[var_name]);
+      }
+    }
+  }
+
+  num_entries_++;
+  return;
+}
+
+void BinaryCodeDataWriter::finish() {
+  auto get_string = [this](uint32_t id) {
+    return id == CODE_DATA_NO_STRING ? llvm::StringRef() : strings_[id];
+  };
+  std::sort(records_.begin(), records_.end(),
+            [&](const CodeDataRecord &lhs, const CodeDataRecord &rhs) {
+              return std::make_tuple(lhs.kind, get_string(lhs.name),
+                                     get_string(lhs.file),
+                                     get_string(lhs.parent)) <
+                     std::make_tuple(rhs.kind, get_string(rhs.name),
+                                     get_string(rhs.file),
+                                     get_string(rhs.parent));
+            });
+
+  std::vector<uint64_t> string_offsets;
+  string_offsets.reserve(strings_.size() + 1);
+  uint64_t string_data_size = 0;
+  for (llvm::StringRef str : strings_) {
+    string_offsets.push_back(string_data_size);
+    string_data_size += str.size() + 1;
+  }
+  string_offsets.push_back(string_data_size);
+
+  CodeDataHeader header = {};
+  std::copy(CODE_DATA_MAGIC, CODE_DATA_MAGIC + 4, header.magic);
+  header.version = CODE_DATA_VERSION;
+  header.num_strings = strings_.size();
+  header.string_offsets_offset = sizeof(CodeDataHeader);
+  header.string_data_offset =
+      header.string_offsets_offset + string_offsets.size() * sizeof(uint64_t);
+  header.string_data_size = string_data_size;
+  header.num_records = records_.size();
+  // Keep the records aligned, so that a mapped file can be used in place.
+  header.records_offset =
+      (header.string_data_offset + string_data_size + 7) & ~uint64_t(7);
+  header.num_edges = edges_.size();
+  header.edges_offset =
+      header.records_offset + records_.size() * sizeof(CodeDataRecord);
+
+  out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out_.write(reinterpret_cast<const char *>(string_offsets.data()),
+             string_offsets.size() * sizeof(uint64_t));
+  for (llvm::StringRef str : strings_) {
+    out_.write(str.data(), str.size());
+    out_.put('\0');
+  }
+  const uint64_t padding =
+      header.records_offset - header.string_data_offset - string_data_size;
+  for (uint64_t idx = 0; idx < padding; idx++) { out_.put('\0'); }
+  out_.write(reinterpret_cast<const char *>(records_.data()),
+             records_.size() * sizeof(CodeDataRecord));
+  out_.write(reinterpret_cast<const char *>(edges_.data()),
+             edges_.size() * sizeof(uint32_t));
+  return;
+}
+
+bool parse_output_format(const std::string &name, OutputFormat &format) {
+  if (name == "json") {
+    format = OutputFormat::JSON;
+    return true;
+  }
+  if (name == "jsonl") {
+    format = OutputFormat::JSONL;
+    return true;
+  }
+  if (name == "binary") {
+    format = OutputFormat::BINARY;
+    return true;
+  }
+  return false;
+}
\ No newline at end of file
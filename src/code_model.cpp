@@ -0,0 +1,425 @@
+#include "code_model.hpp"
+
+#include <algorithm>
+
+// The string of a JSON value, without copying it.
+static llvm::StringRef get_string(const Json::Value &value) {
+  const char *begin = nullptr;
+  const char *end = nullptr;
+  if (!value.isString() || !value.getString(&begin, &end)) { return ""; }
+  return llvm::StringRef(begin, end - begin);
+}
+
+uint32_t CodeModel::intern(llvm::StringRef str) {
+  auto inserted = string_ids_.try_emplace(str, strings_.size());
+  if (inserted.second) { strings_.push_back(inserted.first->getKey()); }
+  return inserted.first->getValue();
+}
+
+llvm::StringRef CodeModel::save(llvm::StringRef str) {
+  if (str.empty()) { return llvm::StringRef(); }
+  char *data = allocator_.Allocate<char>(str.size());
+  std::copy(str.begin(), str.end(), data);
+  return llvm::StringRef(data, str.size());
+}
+
+CodeModel::FileRecord &CodeModel::get_file(llvm::StringRef file_path) {
+  FileRecord *&file = files_[intern(file_path)];
+  if (file == nullptr) { file = new (file_allocator_.Allocate()) FileRecord(); }
+  return *file;
+}
+
+CodeModel::FileRecord *CodeModel::find_file(llvm::StringRef file_path) const {
+  auto id = string_ids_.find(file_path);
+  if (id == string_ids_.end()) { return nullptr; }
+  auto file = files_.find(id->getValue());
+  return file == files_.end() ? nullptr : file->second;
+}
+
+bool CodeModel::has_file(llvm::StringRef file_path) const {
+  return find_file(file_path) != nullptr;
+}
+
+CodeModel::FunctionRecord &CodeModel::get_function(FileRecord     &file,
+                                                   llvm::StringRef func_name) {
+  FunctionRecord *&function = file.functions[intern(func_name)];
+  if (function == nullptr) {
+    function = new (function_allocator_.Allocate()) FunctionRecord();
+  }
+  return *function;
+}
+
+CodeModel::RecordMap &CodeModel::get_records(FileRecord &file,
+                                             RecordKind  kind) {
+  switch (kind) {
+    case RecordKind::MACRO:
+      return file.macros;
+    case RecordKind::ENUM:
+      return file.enums;
+    case RecordKind::TYPE:
+      return file.types;
+    case RecordKind::GLOBAL_VARIABLE:
+      return file.global_variables;
+  }
+  return file.global_variables;
+}
+
+// Overwrites record. The definition is only copied into the arena if it
+// changed, since most entries are the same header seen again.
+void CodeModel::assign_record(CodeRecord &record, llvm::StringRef definition,
+                              int32_t start_line, int32_t end_line) {
+  if (definition != record.definition) { record.definition = save(definition); }
+  record.start_line = start_line;
+  record.end_line = end_line;
+}
+
+void CodeModel::assign_record(CodeRecord &record, const Json::Value &entry) {
+  assign_record(record, get_string(entry["definition"]),
+                entry["start_line"].asInt(), entry["end_line"].asInt());
+}
+
+void CodeModel::merge_records(RecordMap &records, const Json::Value &entries) {
+  for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+    assign_record(records[intern(entry.name())], *entry);
+  }
+}
+
+void CodeModel::merge_records(RecordMap &records, const CodeModel &other,
+                              const RecordMap &other_records) {
+  for (const auto &entry : other_records) {
+    const CodeRecord &record = entry.second;
+    assign_record(records[intern(other.strings_[entry.first])],
+                  record.definition, record.start_line, record.end_line);
+  }
+}
+
+void CodeModel::merge_function(FileRecord &file, llvm::StringRef func_name,
+                               const Json::Value &entry) {
+  FunctionRecord &function = get_function(file, func_name);
+
+  if (entry.isMember("definition")) {
+    assign_record(function.record, entry);
+    function.has_definition = true;
+  }
+  merge_records(function.variables, entry["variables"]);
+  for (const Json::Value &callee : entry["callees"]) {
+    function.callees.insert(intern(get_string(callee)));
+  }
+  for (const Json::Value &caller : entry["callers"]) {
+    function.callers.insert(intern(get_string(caller)));
+  }
+}
+
+void CodeModel::add_file(llvm::StringRef file_path) {
+  get_file(file_path);
+}
+
+void CodeModel::set_function(llvm::StringRef file_path,
+                             llvm::StringRef func_name,
+                             llvm::StringRef definition, int32_t start_line,
+                             int32_t end_line) {
+  FunctionRecord &function = get_function(get_file(file_path), func_name);
+  assign_record(function.record, definition, start_line, end_line);
+  function.has_definition = true;
+}
+
+void CodeModel::set_variable(llvm::StringRef file_path,
+                             llvm::StringRef func_name,
+                             llvm::StringRef var_name,
+                             llvm::StringRef definition, int32_t start_line,
+                             int32_t end_line) {
+  FunctionRecord &function = get_function(get_file(file_path), func_name);
+  assign_record(function.variables[intern(var_name)], definition, start_line,
+                end_line);
+}
+
+void CodeModel::set_record(RecordKind kind, llvm::StringRef file_path,
+                           llvm::StringRef name, llvm::StringRef definition,
+                           int32_t start_line, int32_t end_line) {
+  RecordMap &records = get_records(get_file(file_path), kind);
+  assign_record(records[intern(name)], definition, start_line, end_line);
+}
+
+void CodeModel::add_callee(llvm::StringRef file_path,
+                           llvm::StringRef func_name,
+                           llvm::StringRef callee_name) {
+  get_function(get_file(file_path), func_name)
+      .callees.insert(intern(callee_name));
+}
+
+void CodeModel::add_caller(llvm::StringRef file_path,
+                           llvm::StringRef func_name,
+                           llvm::StringRef caller_name) {
+  get_function(get_file(file_path), func_name)
+      .callers.insert(intern(caller_name));
+}
+
+void CodeModel::add_disabled_macro(llvm::StringRef file_path,
+                                   llvm::StringRef name,
+                                   llvm::StringRef definition,
+                                   int32_t start_line, int32_t end_line) {
+  FileRecord &file = get_file(file_path);
+  file.has_disabled_macros = true;
+
+  CodeRecord record;
+  assign_record(record, definition, start_line, end_line);
+  file.disabled_macros[intern(name)].push_back(record);
+}
+
+void CodeModel::set_preprocessed(llvm::StringRef file_path) {
+  get_file(file_path).has_disabled_macros = true;
+}
+
+void CodeModel::merge_file(llvm::StringRef  file_path,
+                           const CodeModel &other) {
+  const FileRecord *src = other.find_file(file_path);
+  if (src == nullptr) { return; }
+  FileRecord &file = get_file(file_path);
+
+  for (const auto &entry : src->functions) {
+    const FunctionRecord &src_function = *entry.second;
+    FunctionRecord &function = get_function(file, other.strings_[entry.first]);
+
+    if (src_function.has_definition) {
+      const CodeRecord &record = src_function.record;
+      assign_record(function.record, record.definition, record.start_line,
+                    record.end_line);
+      function.has_definition = true;
+    }
+    merge_records(function.variables, other, src_function.variables);
+    for (uint32_t callee_id : src_function.callees) {
+      function.callees.insert(intern(other.strings_[callee_id]));
+    }
+    for (uint32_t caller_id : src_function.callers) {
+      function.callers.insert(intern(other.strings_[caller_id]));
+    }
+  }
+  merge_records(file.macros, other, src->macros);
+  merge_records(file.enums, other, src->enums);
+  merge_records(file.types, other, src->types);
+  merge_records(file.global_variables, other, src->global_variables);
+}
+
+void CodeModel::merge_file_entry(llvm::StringRef    file_path,
+                                 const Json::Value &entry) {
+  FileRecord &file = get_file(file_path);
+
+  const Json::Value &functions = entry["functions"];
+  for (auto function = functions.begin(); function != functions.end();
+       ++function) {
+    merge_function(file, function.name(), *function);
+  }
+  merge_records(file.macros, entry["macros"]);
+  merge_records(file.enums, entry["enums"]);
+  merge_records(file.types, entry["types"]);
+  merge_records(file.global_variables, entry["global_variables"]);
+}
+
+void CodeModel::set_disabled_macros(
+    llvm::StringRef file_path, const std::vector<MacroDefinitionLine> &macros) {
+  FileRecord &file = get_file(file_path);
+  file.disabled_macros.clear();
+  file.has_disabled_macros = true;
+
+  for (const MacroDefinitionLine &macro : macros) {
+    CodeRecord record;
+    record.definition = save(macro.definition);
+    record.start_line = macro.start_line;
+    record.end_line = macro.end_line;
+    file.disabled_macros[intern(macro.name)].push_back(record);
+  }
+}
+
+// Whether the array of disabled definitions has one equal to record.
+static bool contains_record(const Json::Value &defs, llvm::StringRef definition,
+                            int32_t start_line, int32_t end_line) {
+  for (const Json::Value &def : defs) {
+    if (get_string(def["definition"]) == definition &&
+        def["start_line"].asInt() == start_line &&
+        def["end_line"].asInt() == end_line) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CodeModel::intersect_disabled_macros(llvm::StringRef    file_path,
+                                          const Json::Value &disabled_macros) {
+  FileRecord &file = get_file(file_path);
+
+  if (!file.has_disabled_macros) {
+    file.has_disabled_macros = true;
+    for (auto macro = disabled_macros.begin(); macro != disabled_macros.end();
+         ++macro) {
+      llvm::SmallVector<CodeRecord, 1> &defs =
+          file.disabled_macros[intern(macro.name())];
+      for (const Json::Value &def : *macro) {
+        defs.emplace_back();
+        assign_record(defs.back(), def);
+      }
+    }
+    return;
+  }
+
+  for (auto macro = file.disabled_macros.begin();
+       macro != file.disabled_macros.end(); ++macro) {
+    const Json::Value *src_defs =
+        disabled_macros.find(strings_[macro->first].begin(),
+                             strings_[macro->first].end());
+    llvm::SmallVector<CodeRecord, 1> &defs = macro->second;
+    if (src_defs != nullptr) {
+      llvm::erase_if(defs, [&](const CodeRecord &def) {
+        return !contains_record(*src_defs, def.definition, def.start_line,
+                                def.end_line);
+      });
+    }
+    if (src_defs == nullptr || defs.empty()) {
+      file.disabled_macros.erase(macro);
+    }
+  }
+}
+
+void CodeModel::intersect_disabled_macros(llvm::StringRef  file_path,
+                                          const CodeModel &other) {
+  const FileRecord *src = other.find_file(file_path);
+  if (src == nullptr || !src->has_disabled_macros) { return; }
+  FileRecord &file = get_file(file_path);
+
+  if (!file.has_disabled_macros) {
+    file.has_disabled_macros = true;
+    for (const auto &macro : src->disabled_macros) {
+      llvm::SmallVector<CodeRecord, 1> &defs =
+          file.disabled_macros[intern(other.strings_[macro.first])];
+      for (const CodeRecord &def : macro.second) {
+        defs.emplace_back();
+        assign_record(defs.back(), def.definition, def.start_line,
+                      def.end_line);
+      }
+    }
+    return;
+  }
+
+  for (auto macro = file.disabled_macros.begin();
+       macro != file.disabled_macros.end(); ++macro) {
+    auto src_id = other.string_ids_.find(strings_[macro->first]);
+    auto src_defs = src_id == other.string_ids_.end()
+                        ? src->disabled_macros.end()
+                        : src->disabled_macros.find(src_id->getValue());
+    llvm::SmallVector<CodeRecord, 1> &defs = macro->second;
+    if (src_defs != src->disabled_macros.end()) {
+      llvm::erase_if(defs, [&](const CodeRecord &def) {
+        return llvm::none_of(src_defs->second, [&](const CodeRecord &src_def) {
+          return src_def.definition == def.definition &&
+                 src_def.start_line == def.start_line &&
+                 src_def.end_line == def.end_line;
+        });
+      });
+    }
+    if (src_defs == src->disabled_macros.end() || defs.empty()) {
+      file.disabled_macros.erase(macro);
+    }
+  }
+}
+
+void CodeModel::remove_enabled_macros(llvm::StringRef file_path) {
+  FileRecord *file = find_file(file_path);
+  if (file == nullptr) { return; }
+
+  for (auto macro = file->disabled_macros.begin();
+       macro != file->disabled_macros.end(); ++macro) {
+    auto enabled = file->macros.find(macro->first);
+    if (enabled == file->macros.end()) { continue; }
+
+    llvm::SmallVector<CodeRecord, 1> &defs = macro->second;
+    llvm::erase_if(defs, [&](const CodeRecord &def) {
+      return def.definition == enabled->second.definition;
+    });
+    if (defs.empty()) { file->disabled_macros.erase(macro); }
+  }
+}
+
+std::vector<std::string> CodeModel::get_file_paths() const {
+  std::vector<std::string> file_paths;
+  file_paths.reserve(files_.size());
+  for (const auto &file : files_) {
+    file_paths.push_back(strings_[file.first].str());
+  }
+  std::sort(file_paths.begin(), file_paths.end());
+  return file_paths;
+}
+
+Json::Value CodeModel::record_to_json(const CodeRecord &record) const {
+  Json::Value entry(Json::objectValue);
+  entry["definition"] = record.definition.str();
+  entry["start_line"] = record.start_line;
+  entry["end_line"] = record.end_line;
+  return entry;
+}
+
+Json::Value CodeModel::records_to_json(const RecordMap &records) const {
+  Json::Value entries(Json::objectValue);
+  for (const auto &record : records) {
+    entries[strings_[record.first].str()] = record_to_json(record.second);
+  }
+  return entries;
+}
+
+// Names are added in hash order, and Json::Value sorts them.
+Json::Value CodeModel::to_json(llvm::StringRef file_path,
+                               bool omit_unknown_disabled_macros) const {
+  Json::Value entry(Json::objectValue);
+  for (const char *key : {"functions", "macros", "enums", "types",
+                          "global_variables", "disabled_macros"}) {
+    entry[key] = Json::Value(Json::objectValue);
+  }
+
+  const FileRecord *file = find_file(file_path);
+  if (file == nullptr) { return entry; }
+
+  Json::Value &functions = entry["functions"];
+  for (const auto &function : file->functions) {
+    const FunctionRecord &record = *function.second;
+    Json::Value           func_entry(Json::objectValue);
+
+    if (record.has_definition) { func_entry = record_to_json(record.record); }
+    if (!record.variables.empty()) {
+      func_entry["variables"] = records_to_json(record.variables);
+    }
+    if (!record.callees.empty()) {
+      Json::Value &callees = func_entry["callees"];
+      callees = Json::Value(Json::arrayValue);
+      for (uint32_t callee_id : record.callees) {
+        callees.append(strings_[callee_id].str());
+      }
+    }
+    if (!record.callers.empty()) {
+      Json::Value &callers = func_entry["callers"];
+      callers = Json::Value(Json::arrayValue);
+      for (uint32_t caller_id : record.callers) {
+        callers.append(strings_[caller_id].str());
+      }
+    }
+
+    functions[strings_[function.first].str()] = std::move(func_entry);
+  }
+
+  entry["macros"] = records_to_json(file->macros);
+  entry["enums"] = records_to_json(file->enums);
+  entry["types"] = records_to_json(file->types);
+  entry["global_variables"] = records_to_json(file->global_variables);
+
+  if (omit_unknown_disabled_macros && !file->has_disabled_macros) {
+    entry.removeMember("disabled_macros");
+    return entry;
+  }
+
+  Json::Value &disabled_macros = entry["disabled_macros"];
+  for (const auto &macro : file->disabled_macros) {
+    Json::Value &defs = disabled_macros[strings_[macro.first].str()];
+    defs = Json::Value(Json::arrayValue);
+    for (const CodeRecord &def : macro.second) {
+      defs.append(record_to_json(def));
+    }
+  }
+  return entry;
+}
\ No newline at end of file
@@ -2,8 +2,17 @@
 
 #include <limits.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "system_include_dirs.hpp"
 
 // Assume argv contains "--" followed by compile arguments
 // If it does not, return an empty std::vector
@@ -25,99 +34,187 @@ std::vector<std::string> get_compile_args(int argc, const char **argv) {
     idx++;
   }
 
-  add_system_include_paths(result);
+  // argv[1] is the source file of the tools using this
+  const std::string src_path = argc > 1 ? argv[1] : "";
+  add_system_include_paths(result, get_driver_for_source(src_path, result));
 
   return result;
 }
 
-static const std::vector<std::string> &get_system_include_dirs() {
-  static std::vector<std::string> system_include_dirs;
-
-  if (!system_include_dirs.empty()) { return system_include_dirs; }
+// Get the system include paths of clang
+// and add them to the compile args
+void add_system_include_paths(std::vector<std::string> &compile_args,
+                              const std::string        &driver) {
+  const std::vector<std::string> &system_include_dirs =
+      get_system_include_dirs(driver);
 
-  const char *cmd = "clang -E -x c++ - -v < /dev/null 2>&1";
-  FILE       *fp = popen(cmd, "r");
-  if (fp == NULL) {
-    std::cerr << "Error: could not run command: " << cmd << "\n";
-    return system_include_dirs;
+  for (const std::string &dir : system_include_dirs) {
+    compile_args.push_back("-isystem");
+    compile_args.push_back(dir);
   }
 
-  char buffer[256];
-  bool found_include_start = false;
-  while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-    std::string line(buffer);
-    if (found_include_start) {
-      if (line.find("End of search list.") != std::string::npos) {
-        found_include_start = false;
-        continue;
-      }
+  return;
+}
 
-      if (line.find("starts here") != std::string::npos) { continue; }
+void PathPrefixTrie::insert(const std::string &prefix) {
+  size_t node = 0;
+  for_each_component(prefix, [&](const std::string &component) {
+    auto child = nodes_[node].children.find(component);
+    if (child != nodes_[node].children.end()) {
+      node = child->second;
+      return true;
+    }
+    nodes_.emplace_back();
+    nodes_[node].children.emplace(component, nodes_.size() - 1);
+    node = nodes_.size() - 1;
+    return true;
+  });
+  if (node != 0) { nodes_[node].is_prefix = true; }
+}
 
-      if (line.empty()) { continue; }
+bool PathPrefixTrie::matches(const std::string &path) const {
+  size_t node = 0;
+  bool   found = false;
+  for_each_component(path, [&](const std::string &component) {
+    auto child = nodes_[node].children.find(component);
+    if (child == nodes_[node].children.end()) { return false; }
+    node = child->second;
+    found = nodes_[node].is_prefix;
+    return !found;
+  });
+  return found;
+}
 
-      if (line[0] == ' ') { line = line.substr(1); }
+// Calls callback with each component of path until it returns false. Empty
+// components are skipped, and an absolute path starts with a "/" component.
+void PathPrefixTrie::for_each_component(
+    const std::string                              &path,
+    const std::function<bool(const std::string &)> &callback) {
+  size_t pos = 0;
+  if (!path.empty() && path[0] == '/') {
+    if (!callback("/")) { return; }
+    pos = 1;
+  }
 
-      const size_t len = line.length();
+  while (pos < path.size()) {
+    size_t end = path.find('/', pos);
+    if (end == std::string::npos) { end = path.size(); }
+    if (end > pos && !callback(path.substr(pos, end - pos))) { return; }
+    pos = end + 1;
+  }
+}
 
-      if (line[len - 1] == '\n') { line = line.substr(0, len - 1); }
+// The system include directories, both as reported by clang and canonical,
+// and the prefixes listed in the SYSTEM_PREFIXES environment variable.
+static PathPrefixTrie build_system_prefix_trie() {
+  PathPrefixTrie trie;
 
-      system_include_dirs.push_back(line);
-      continue;
-    }
-
-    if (line.find("#include <...> search starts here") != std::string::npos) {
-      found_include_start = true;
-      continue;
+  for (const char *driver : {"clang", "clang++"}) {
+    for (const std::string &dir : get_system_include_dirs(driver)) {
+      trie.insert(dir);
+      const std::string canonical_dir = get_canonical_abs_path(dir);
+      if (!canonical_dir.empty()) { trie.insert(canonical_dir); }
     }
+  }
 
-    if (line.find("#include \"...\" search starts here") != std::string::npos) {
-      found_include_start = true;
-      continue;
-    }
+  const char *env_val = std::getenv("SYSTEM_PREFIXES");
+  if (env_val != nullptr) {
+    std::istringstream prefixes(env_val);
+    std::string        prefix;
+    while (prefixes >> prefix) { trie.insert(prefix); }
   }
-  pclose(fp);
-  return system_include_dirs;
+
+  return trie;
 }
 
-// Execute clang and get the system include paths
-// and add them to the compile args
-void add_system_include_paths(std::vector<std::string> &compile_args) {
-  const std::vector<std::string> &system_include_dirs =
-      get_system_include_dirs();
+// Whether path contains "include/clang/", "include/llvm/" or
+// "include/llvm-c/", in a single scan.
+static bool is_llvm_header(const std::string &file_path) {
+  static const char *llvm_dirs[] = {"clang/", "llvm/", "llvm-c/"};
 
-  for (const std::string &dir : system_include_dirs) {
-    compile_args.push_back("-isystem");
-    compile_args.push_back(dir);
+  size_t pos = file_path.find("include/");
+  while (pos != std::string::npos) {
+    pos += strlen("include/");
+    for (const char *dir : llvm_dirs) {
+      if (file_path.compare(pos, strlen(dir), dir) == 0) { return true; }
+    }
+    pos = file_path.find("include/", pos);
   }
-
-  return;
+  return false;
 }
 
 bool is_system_file(const std::string &file_path) {
-  const std::vector<std::string> &system_include_dirs =
-      get_system_include_dirs();
+  static const PathPrefixTrie system_prefixes = build_system_prefix_trie();
 
-  for (const std::string &dir : system_include_dirs) {
-    if (file_path.find(dir) == 0) { return true; }
+  return system_prefixes.matches(file_path) || is_llvm_header(file_path);
+}
+
+// Results of realpath(), shared by all threads. Failures are cached too, as
+// an empty path, so that the error is reported once per path.
+static std::shared_mutex                            canonical_paths_mutex;
+static std::unordered_map<std::string, std::string> canonical_paths;
+static std::atomic<size_t>                          canonical_path_hits{0};
+static std::atomic<size_t>                          canonical_path_misses{0};
+
+std::string get_canonical_abs_path(const std::string &file_path) {
+  if (file_path == "") { return ""; }
+
+  // A relative path depends on the current directory, which func_query_server
+  // changes per query, so it is cached under its absolute path.
+  std::string key = file_path;
+  if (file_path[0] != '/') {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) != nullptr) {
+      key = std::string(cwd) + "/" + file_path;
+    }
   }
 
-  if (file_path.find("include/clang/") != std::string::npos) { return true; }
+  {
+    std::shared_lock<std::shared_mutex> lock(canonical_paths_mutex);
+    auto cached = canonical_paths.find(key);
+    if (cached != canonical_paths.end()) {
+      canonical_path_hits++;
+      return cached->second;
+    }
+  }
+  canonical_path_misses++;
 
-  if (file_path.find("include/llvm/") != std::string::npos) { return true; }
+  std::string canonical_path;
+  char        abs_path[PATH_MAX];
+  if (realpath(file_path.c_str(), abs_path) == nullptr) {
+    std::cerr << "Error: could not get absolute path for " << file_path << "\n";
+  } else {
+    canonical_path = abs_path;
+  }
 
-  if (file_path.find("include/llvm-c/") != std::string::npos) { return true; }
-  return false;
+  std::unique_lock<std::shared_mutex> lock(canonical_paths_mutex);
+  canonical_paths.emplace(key, canonical_path);
+  return canonical_path;
 }
 
-std::string get_canonical_abs_path(const std::string &file_path) {
+void clear_canonical_path_cache() {
+  std::unique_lock<std::shared_mutex> lock(canonical_paths_mutex);
+  canonical_paths.clear();
+}
+
+size_t get_canonical_path_cache_hits() {
+  return canonical_path_hits;
+}
+
+size_t get_canonical_path_cache_misses() {
+  return canonical_path_misses;
+}
+
+// Resolve a relative path against the given working directory instead of the
+// process-wide current directory, so that translation units with different
+// working directories can be processed concurrently.
+std::string get_canonical_abs_path(const std::string &file_path,
+                                   const std::string &working_dir) {
   if (file_path == "") { return ""; }
-  char abs_path[PATH_MAX];
-  if (realpath(file_path.c_str(), abs_path) == nullptr) {
-    std::cerr << "Error: could not get absolute path for " << file_path << "\n";
-    return "";
+  if (file_path[0] == '/' || working_dir.empty()) {
+    return get_canonical_abs_path(file_path);
   }
-  return std::string(abs_path);
+  return get_canonical_abs_path(working_dir + "/" + file_path);
 }
 
 std::string strip(const std::string &s) {
@@ -134,23 +231,59 @@ bool ends_with(const std::string &s, const std::string &suffix) {
   return s.compare(str_size - suffix_size, suffix_size, suffix) == 0;
 }
 
+// Splits a command line the way a POSIX shell does: words are separated by
+// unquoted whitespace, single quotes keep everything literally, double quotes
+// keep everything but a backslash before $, `, " or \, and an unquoted
+// backslash escapes the next character. It reads the wrapper lines quoted
+// with shlex.join(), the "command" of compile_commands.json, response files
+// and the EXCLUDES environment variable. Older wrapper lines, which are joined
+// by plain spaces, are split by split_legacy_line() instead.
 std::vector<std::string> tokenize_command(const std::string &command) {
   std::vector<std::string> tokens;
-  size_t                   pos = 0;
-  size_t                   space_pos = command.find(' ');
-
-  while (space_pos != std::string::npos) {
-    std::string token = command.substr(pos, space_pos - pos);
-    tokens.push_back(token);
-    pos = space_pos + 1;
-    space_pos = command.find(' ', pos);
-  }
+  std::string              token;
+  bool                     in_token = false;
+  const size_t             size = command.size();
+
+  for (size_t pos = 0; pos < size; pos++) {
+    const char c = command[pos];
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+      if (in_token) { tokens.push_back(std::move(token)); }
+      token.clear();
+      in_token = false;
+      continue;
+    }
+
+    in_token = true;
+
+    if (c == '\\') {
+      if (pos + 1 < size) { token += command[++pos]; }
+      continue;
+    }
 
-  // last token
-  if (pos < command.length()) {
-    std::string token = command.substr(pos);
-    tokens.push_back(token);
+    if (c == '\'') {
+      const size_t end = command.find('\'', pos + 1);
+      const size_t stop = end == std::string::npos ? size : end;
+      token.append(command, pos + 1, stop - pos - 1);
+      pos = stop;
+      continue;
+    }
+
+    if (c == '"') {
+      for (pos++; pos < size && command[pos] != '"'; pos++) {
+        if (command[pos] == '\\' && pos + 1 < size &&
+            strchr("$`\"\\", command[pos + 1]) != nullptr) {
+          pos++;
+        }
+        token += command[pos];
+      }
+      continue;
+    }
+
+    token += c;
   }
 
+  if (in_token) { tokens.push_back(std::move(token)); }
+
   return tokens;
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "diagnostic_counters.hpp"
+
+const char *get_diagnostic_name(Diagnostic diag) {
+  switch (diag) {
+    case Diagnostic::INDIRECT_CALL:
+      return "indirect_call";
+    case Diagnostic::DEPENDENT_CALL:
+      return "dependent_call";
+    case Diagnostic::SYSTEM_CALLEE:
+      return "system_callee";
+  }
+  return "unknown";
+}
+
+void DiagnosticCounters::add_sample(Diagnostic diag, std::string sample) {
+  std::vector<std::string> &samples = samples_[static_cast<size_t>(diag)];
+  if (samples.size() < MAX_SAMPLES) { samples.push_back(std::move(sample)); }
+}
+
+void DiagnosticCounters::merge(const DiagnosticCounters &other) {
+  for (size_t index = 0; index < NUM_DIAGNOSTICS; index++) {
+    counts_[index] += other.counts_[index];
+    for (const std::string &sample : other.samples_[index]) {
+      add_sample(static_cast<Diagnostic>(index), sample);
+    }
+  }
+}
+
+void DiagnosticCounters::print_summary(std::ostream &out) const {
+  for (size_t index = 0; index < NUM_DIAGNOSTICS; index++) {
+    if (counts_[index] == 0) { continue; }
+    out << "Skipped " << get_diagnostic_name(static_cast<Diagnostic>(index))
+        << ": " << counts_[index] << "\n";
+    for (const std::string &sample : samples_[index]) {
+      out << "  e.g. " << sample << "\n";
+    }
+  }
+}
+
+Json::Value DiagnosticCounters::to_json() const {
+  Json::Value json(Json::objectValue);
+  for (size_t index = 0; index < NUM_DIAGNOSTICS; index++) {
+    Json::Value &entry =
+        json[get_diagnostic_name(static_cast<Diagnostic>(index))];
+    entry["count"] = static_cast<Json::UInt64>(counts_[index]);
+    Json::Value &samples = entry["samples"];
+    samples = Json::Value(Json::arrayValue);
+    for (const std::string &sample : samples_[index]) {
+      samples.append(sample);
+    }
+  }
+  return json;
+}
+
+bool DiagnosticCounters::from_json(const Json::Value &json) {
+  if (!json.isObject()) { return false; }
+
+  for (size_t index = 0; index < NUM_DIAGNOSTICS; index++) {
+    const Diagnostic   diag = static_cast<Diagnostic>(index);
+    const Json::Value &entry = json[get_diagnostic_name(diag)];
+    if (!entry.isObject() || !entry["count"].isUInt64() ||
+        !entry["samples"].isArray()) {
+      return false;
+    }
+
+    counts_[index] += entry["count"].asUInt64();
+    for (const Json::Value &sample : entry["samples"]) {
+      add_sample(diag, sample.asString());
+    }
+  }
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "func_query_client.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+std::string serialize_query(const FuncQuery &query) {
+  std::string data;
+  for (const std::string *field : {&query.working_dir, &query.command,
+                                   &query.src_path, &query.func_name}) {
+    data += *field;
+    data += '\0';
+  }
+  for (const std::string &arg : query.compile_args) {
+    data += arg;
+    data += '\0';
+  }
+  return data;
+}
+
+bool deserialize_query(const std::string &data, FuncQuery &query) {
+  std::vector<std::string> fields;
+  size_t                   pos = 0;
+  while (pos < data.size()) {
+    const size_t end = data.find('\0', pos);
+    if (end == std::string::npos) { return false; }
+    fields.push_back(data.substr(pos, end - pos));
+    pos = end + 1;
+  }
+
+  if (fields.size() < 4) { return false; }
+
+  query.working_dir = fields[0];
+  query.command = fields[1];
+  query.src_path = fields[2];
+  query.func_name = fields[3];
+  query.compile_args.assign(fields.begin() + 4, fields.end());
+  return true;
+}
+
+bool write_all(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    const ssize_t ret =
+        write(fd, data.data() + written, data.size() - written);
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret <= 0) { return false; }
+    written += ret;
+  }
+  return true;
+}
+
+bool read_all(int fd, std::string &data) {
+  char buffer[4096];
+  while (true) {
+    const ssize_t ret = read(fd, buffer, sizeof(buffer));
+    if (ret < 0 && errno == EINTR) { continue; }
+    if (ret < 0) { return false; }
+    if (ret == 0) { return true; }
+    data.append(buffer, ret);
+  }
+}
+
+bool run_query_on_server(const FuncQuery &query, int &exit_code) {
+  const char *socket_path = std::getenv(FUNC_QUERY_SOCKET_ENV);
+  if (socket_path == nullptr || socket_path[0] == '\0') { return false; }
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) { return false; }
+  strcpy(addr.sun_path, socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) { return false; }
+
+  // Nothing has been printed before the response arrives, so any failure up
+  // to that point falls back to parsing locally.
+  std::string response;
+  const bool  success =
+      connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 &&
+      write_all(fd, serialize_query(query)) && shutdown(fd, SHUT_WR) == 0 &&
+      read_all(fd, response);
+  close(fd);
+
+  if (!success || response.size() < 2 || response[1] != '\n') {
+    return false;
+  }
+
+  // Errors go to stderr, as when the query is run locally.
+  exit_code = response[0] == '0' ? 0 : 1;
+  (exit_code == 0 ? std::cout : std::cerr) << response.substr(2);
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include "func_query_server.hpp"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "clang/Tooling/Tooling.h"
+#include "cpp_code_extractor_util.hpp"
+#include "func_query_client.hpp"
+#include "get_func_list.hpp"
+#include "get_func_src.hpp"
+
+// ////////////////////////
+// ASTCache class
+// ////////////////////////
+
+static std::string get_abs_path(const std::string &file_path,
+                                const std::string &working_dir) {
+  if (file_path.empty() || file_path[0] == '/') { return file_path; }
+  return working_dir + "/" + file_path;
+}
+
+static bool get_modification_time(const std::string &file_path,
+                                  time_t            &mtime) {
+  struct stat file_stat;
+  if (stat(file_path.c_str(), &file_stat) != 0) { return false; }
+  mtime = file_stat.st_mtime;
+  return true;
+}
+
+bool ASTCache::is_up_to_date(const Entry &entry) {
+  for (const auto &[file_path, mtime] : entry.files) {
+    time_t current_mtime;
+    if (!get_modification_time(file_path, current_mtime) ||
+        current_mtime != mtime) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ASTCache::evict() {
+  // The most recently used entry is kept even if it alone exceeds the limit
+  while (memory_ > max_memory_ && entries_.size() > 1) {
+    memory_ -= entries_.back().memory;
+    index_.erase(entries_.back().key);
+    entries_.pop_back();
+  }
+}
+
+clang::ASTUnit *ASTCache::get(const std::string              &working_dir,
+                              const std::string              &src_path,
+                              const std::vector<std::string> &compile_args,
+                              std::string                    &error) {
+  std::string key = working_dir + '\0' + src_path;
+  for (const std::string &arg : compile_args) { key += '\0' + arg; }
+
+  auto cached = index_.find(key);
+  if (cached != index_.end()) {
+    if (is_up_to_date(*cached->second)) {
+      num_hits_++;
+      entries_.splice(entries_.begin(), entries_, cached->second);
+      return entries_.front().ast.get();
+    }
+    memory_ -= cached->second->memory;
+    entries_.erase(cached->second);
+    index_.erase(cached);
+  }
+  num_misses_++;
+
+  // Taken before reading, so that an edit made while parsing is noticed by
+  // the next query
+  time_t src_mtime;
+  if (!get_modification_time(src_path, src_mtime)) {
+    error = "could not open source file " + src_path;
+    return nullptr;
+  }
+
+  std::ifstream src_file(src_path);
+  if (!src_file.is_open()) {
+    error = "could not open source file " + src_path;
+    return nullptr;
+  }
+
+  std::stringstream src_buffer;
+  src_buffer << src_file.rdbuf();
+  src_file.close();
+
+  std::unique_ptr<clang::ASTUnit> ast =
+      clang::tooling::buildASTFromCodeWithArgs(src_buffer.str(), compile_args,
+                                               src_path);
+  if (ast == nullptr) {
+    error = "could not parse " + src_path;
+    return nullptr;
+  }
+
+  Entry entry;
+  entry.key = key;
+  entry.files.emplace_back(get_abs_path(src_path, working_dir), src_mtime);
+
+  // The main file is an in-memory buffer, so its file entry has no
+  // meaningful modification time
+  clang::SourceManager &src_manager = ast->getSourceManager();
+  for (auto file = src_manager.fileinfo_begin();
+       file != src_manager.fileinfo_end(); ++file) {
+    const std::string file_path = file->first.getName().str();
+    if (file_path == src_path) { continue; }
+    entry.files.emplace_back(get_abs_path(file_path, working_dir),
+                             file->first.getModificationTime());
+  }
+
+  const clang::ASTContext &ctx = ast->getASTContext();
+  entry.memory = ctx.getASTAllocatedMemory() +
+                 ctx.getSideTableAllocatedMemory() +
+                 src_manager.getContentCacheSize() +
+                 src_manager.getDataStructureSizes() +
+                 ast->getPreprocessor().getTotalMemory();
+  entry.ast = std::move(ast);
+
+  memory_ += entry.memory;
+  entries_.push_front(std::move(entry));
+  index_.emplace(key, entries_.begin());
+  evict();
+
+  return entries_.front().ast.get();
+}
+
+// ////////////////////////
+// Query handling
+// ////////////////////////
+
+// Runs the query on a cached AST. Returns false and sets error on failure.
+static bool run_query(ASTCache &ast_cache, const FuncQuery &query,
+                      std::ostream &out, std::string &error) {
+  if (query.command != "list" && query.command != "src" &&
+      query.command != "src_batch") {
+    error = "unknown command " + query.command;
+    return false;
+  }
+
+  // Relative paths in the query and in the compile args are relative to the
+  // working directory of the client
+  if (chdir(query.working_dir.c_str()) != 0) {
+    error = "could not change directory to " + query.working_dir;
+    return false;
+  }
+
+  // The files of the client may have changed since the last query, and the
+  // cache would otherwise grow with every client for the lifetime of the
+  // server.
+  clear_canonical_path_cache();
+
+  clang::ASTUnit *ast = ast_cache.get(query.working_dir, query.src_path,
+                                      query.compile_args, error);
+  if (ast == nullptr) { return false; }
+
+  clang::SourceManager &src_manager = ast->getSourceManager();
+  auto main_file_ref =
+      src_manager.getFileEntryRefForID(src_manager.getMainFileID());
+  if (!main_file_ref) {
+    error = "could not get main file of " + query.src_path;
+    return false;
+  }
+  llvm::StringRef main_file_name = main_file_ref->getName();
+
+  clang::TranslationUnitDecl *tu_decl =
+      ast->getASTContext().getTranslationUnitDecl();
+  if (query.command == "list") {
+    FunctionVisitor visitor(src_manager, main_file_name, out);
+    visitor.TraverseDecl(tu_decl);
+  } else if (query.command == "src") {
+    const std::unordered_set<std::string> func_names = {query.func_name};
+    FuncSrcVisitor visitor(src_manager, ast->getLangOpts(), main_file_name,
+                           func_names, nullptr, out);
+    visitor.TraverseDecl(tu_decl);
+  } else {
+    std::istringstream                    names(query.func_name);
+    const std::unordered_set<std::string> func_names = read_func_names(names);
+    Json::Value output_json = Json::Value(Json::objectValue);
+    FuncSrcVisitor visitor(src_manager, ast->getLangOpts(), main_file_name,
+                           func_names, &output_json, out);
+    visitor.TraverseDecl(tu_decl);
+    out << output_json.toStyledString();
+  }
+
+  return true;
+}
+
+static void handle_connection(ASTCache &ast_cache, int fd) {
+  std::string request;
+  FuncQuery   query;
+  if (!read_all(fd, request) || !deserialize_query(request, query)) {
+    write_all(fd, "1\nError: malformed query\n");
+    return;
+  }
+
+  std::ostringstream out;
+  std::string        error;
+  if (run_query(ast_cache, query, out, error)) {
+    write_all(fd, "0\n" + out.str());
+  } else {
+    write_all(fd, "1\nError: " + error + "\n");
+  }
+}
+
+// ////////////////////////
+// main function
+// ////////////////////////
+
+int main(int argc, const char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " <socket-path> [--max-memory <MB>]\n";
+    return 1;
+  }
+
+  const char *socket_path = argv[1];
+  size_t      max_memory_mb = 2048;
+
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+      max_memory_mb = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      std::cerr << "Error: unknown option " << argv[i] << "\n";
+      return 1;
+    }
+  }
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    std::cerr << "Error: socket path is too long " << socket_path << "\n";
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  // A client that went away must not terminate the server
+  signal(SIGPIPE, SIG_IGN);
+
+  const int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if (server_fd < 0 ||
+      bind(server_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      listen(server_fd, SOMAXCONN) != 0) {
+    std::cerr << "Error: could not listen on " << socket_path << ": "
+              << strerror(errno) << "\n";
+    return 1;
+  }
+
+  std::cout << "Listening on " << socket_path << "\n";
+  std::cout << "Set " << FUNC_QUERY_SOCKET_ENV << "=" << socket_path
+            << " for get_func_list and get_func_src to use this server\n";
+
+  ASTCache ast_cache(max_memory_mb * 1024 * 1024);
+
+  // Queries are answered one at a time, since the current directory is set
+  // per query and ASTs are not shared between threads
+  while (true) {
+    const int fd = accept(server_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR) { continue; }
+      std::cerr << "Error: accept failed: " << strerror(errno) << "\n";
+      break;
+    }
+    handle_connection(ast_cache, fd);
+    close(fd);
+
+#if PRINT_DEBUG == 1
+    std::cerr << "AST cache: " << ast_cache.get_num_hits() << " hits, "
+              << ast_cache.get_num_misses() << " misses, "
+              << ast_cache.get_memory() / (1024 * 1024) << " MB\n";
+#endif
+  }
+
+  close(server_fd);
+  unlink(socket_path);
+  return 1;
+}
\ No newline at end of file
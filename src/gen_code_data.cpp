@@ -1,89 +1,56 @@
 #include "gen_code_data.hpp"
 
+#include <condition_variable>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <regex>
+#include <mutex>
 #include <set>
 #include <sstream>
+#include <thread>
 
 #include "CompileCommand.hpp"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Index/USRGeneration.h"
 #include "clang/Lex/Lexer.h"
 #include "clang/Tooling/Tooling.h"
+#include "code_data_writer.hpp"
+#include "code_model.hpp"
 #include "cpp_code_extractor_util.hpp"
-#include "json_utils.hpp"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/xxhash.h"
+#include "macro_scanner.hpp"
+#include "system_include_dirs.hpp"
+#include "tu_cache.hpp"
 
 namespace fs = std::filesystem;
 
-static std::string get_macro_name(const std::string &line) {
-  size_t pos = line.find("define");
-  if (pos == std::string::npos) { return ""; }
-  std::string name = line.substr(pos + 7);
-  pos = name.find(' ');
-  if (pos != std::string::npos) { name = name.substr(0, pos); }
-  pos = name.find('\t');
-  if (pos != std::string::npos) { name = name.substr(0, pos); }
-  pos = name.find('(');
-  if (pos != std::string::npos) { name = name.substr(0, pos); }
-  name = strip(name);
-  return name;
-}
-
-static void collect_disabled_macros(Json::Value       &output_json,
+// The SymbolID of a declaration, or 0 if clang cannot generate its USR.
+static SymbolID get_decl_symbol_id(const clang::Decl *decl) {
+  llvm::SmallString<128> usr;
+  if (clang::index::generateUSRForDecl(decl, usr)) { return 0; }
+  return get_symbol_id(usr);
+}
+
+// Called once per file, when the file first shows up in the merged output.
+static void collect_disabled_macros(CodeModel         &model,
                                     const std::string &file_path) {
-  static std::set<std::string> visited_files;
-  if (visited_files.find(file_path) != visited_files.end()) { return; }
-  visited_files.insert(file_path);
+  llvm::TimeTraceScope trace_scope("CollectDisabledMacros", file_path);
 
-  std::ifstream file(file_path);
-  if (!file.is_open()) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(file_path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
     llvm::outs() << "Failed to open file: " << file_path << "\n";
     return;
   }
 
-  ensure_key(output_json, file_path);
-  Json::Value &file_entry = output_json[file_path];
-
-  file_entry["disabled_macros"] = Json::Value(Json::objectValue);
-  Json::Value &disabled_macros = file_entry["disabled_macros"];
-
-  std::regex pattern(R"(^\s*#\s*define\b)");
-
-  std::string line;
-  std::string macro_line = "";
-  int32_t     line_no = 0;
-  while (getline(file, line)) {
-    line_no++;
-    if (!std::regex_search(line, pattern)) { continue; }
-
-    macro_line = strip(line);
-    int32_t start_line_no = line_no - 1;
-    while (ends_with(line, "\\")) {
-      getline(file, line);
-      line_no++;
-      macro_line += "\n" + strip(line);
-    }
-    int32_t           end_line_no = line_no;
-    const std::string macro_name = get_macro_name(macro_line);
-
-    if (macro_name.empty()) { continue; }
-
-    if (!disabled_macros.isMember(macro_name)) {
-      disabled_macros[macro_name] = Json::Value(Json::arrayValue);
-    }
-
-    Json::Value &macro_defs = disabled_macros[macro_name];
-
-    Json::Value macro_info;
-    macro_info["definition"] = macro_line;
-    macro_info["start_line"] = start_line_no;
-    macro_info["end_line"] = end_line_no;
-
-    macro_defs.append(macro_info);
-  }
-
+  model.set_disabled_macros(file_path,
+                            scan_macro_definitions((*buffer)->getBuffer()));
   return;
 }
 
@@ -103,9 +70,98 @@ static void                  get_excludes() {
   return;
 }
 
+// /////////////////////////
+// HeaderRegistry class
+// /////////////////////////
+bool HeaderRegistry::claim(const std::string &file_path, uint64_t content_hash,
+                           uint64_t config_hash) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return headers_.emplace(file_path, content_hash, config_hash).second;
+}
+
+// /////////////////////////
+// HeaderFilter class
+// /////////////////////////
+bool HeaderFilter::is_harvested_elsewhere(clang::SourceManager &src_manager,
+                                          clang::SourceLocation loc) {
+  if (registry_ == nullptr || loc.isInvalid()) { return false; }
+
+  const clang::FileID file_id =
+      src_manager.getFileID(src_manager.getExpansionLoc(loc));
+  if (file_id.isInvalid() || file_id == src_manager.getMainFileID()) {
+    return false;
+  }
+
+  auto cached = skipped_files_.find(file_id);
+  if (cached != skipped_files_.end()) { return cached->second; }
+
+  bool skip = false;
+
+  clang::OptionalFileEntryRef file_ref =
+      src_manager.getFileEntryRefForID(file_id);
+  std::optional<llvm::StringRef> buffer =
+      src_manager.getBufferDataOrNone(file_id);
+
+  if (file_ref && buffer) {
+    const std::string file_path =
+        get_canonical_abs_path(file_ref->getName().str(), working_dir_);
+
+    // A header may be entered several times by the same translation unit, so
+    // the files claimed by this translation unit are remembered.
+    if (!file_path.empty() &&
+        claimed_files_.find(file_path) == claimed_files_.end()) {
+      const uint64_t content_hash = llvm::xxh3_64bits(*buffer);
+      if (registry_->claim(file_path, content_hash, config_hash_)) {
+        claimed_files_.insert(file_path);
+      } else {
+        skip = true;
+      }
+    }
+  }
+
+  skipped_files_[file_id] = skip;
+  return skip;
+}
+
+bool HeaderFilter::skipped_any() const {
+  for (const auto &entry : skipped_files_) {
+    if (entry.second) { return true; }
+  }
+  return false;
+}
+
 // /////////////////////////
 // CodeDataVisitor class
 // /////////////////////////
+bool CodeDataVisitor::TraverseDecl(clang::Decl *D) {
+  if (D != nullptr && !llvm::isa<clang::TranslationUnitDecl>(D) &&
+      system_filter_.is_system_loc(D->getLocation())) {
+    return true;
+  }
+
+  // Namespaces and linkage specifications may wrap #include directives, so
+  // their children are checked one by one instead of pruning the whole block.
+  if (D != nullptr &&
+      !llvm::isa<clang::TranslationUnitDecl, clang::NamespaceDecl,
+                 clang::LinkageSpecDecl>(D) &&
+      header_filter_.is_harvested_elsewhere(src_manager_, D->getLocation())) {
+    return true;
+  }
+
+  // Calls belong to the innermost function definition, e.g. to a method of a
+  // local class rather than to the function around it.
+  if (D != nullptr && llvm::isa<clang::FunctionDecl>(D)) {
+    Caller outer_caller = std::move(caller_);
+    caller_ = Caller();
+    const bool result =
+        clang::RecursiveASTVisitor<CodeDataVisitor>::TraverseDecl(D);
+    caller_ = std::move(outer_caller);
+    return result;
+  }
+
+  return clang::RecursiveASTVisitor<CodeDataVisitor>::TraverseDecl(D);
+}
+
 bool CodeDataVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
   if (!FuncDecl->isThisDeclarationADefinition()) { return true; }
 
@@ -116,16 +172,8 @@ bool CodeDataVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
   llvm::StringRef       file_name = src_manager_.getFilename(loc);
   if (file_name == "") { return true; }
 
-  const std::string file_path = get_canonical_abs_path(file_name.str());
-
-  if (is_system_file(file_path)) { return true; }
-
-  ensure_file_key(output_json_, file_path);
-
-  collect_disabled_macros(output_json_, file_path);
-
-  Json::Value &file_entry = output_json_[file_path];
-  Json::Value &functions_entry = file_entry["functions"];
+  const std::string file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   // get function source code
 
@@ -141,235 +189,191 @@ bool CodeDataVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
   const int32_t start_line_no = src_manager_.getSpellingLineNumber(start_loc);
   const int32_t end_line_no = src_manager_.getSpellingLineNumber(end_loc);
 
-  ensure_key(functions_entry, func_name);
-  Json::Value &func_entry = functions_entry[func_name];
-  func_entry["definition"] = src_code;
-  func_entry["start_line"] = start_line_no;
-  func_entry["end_line"] = end_line_no;
+  model_.set_function(file_path, func_name, src_code, start_line_no,
+                      end_line_no);
+
+  const SymbolID func_id = get_decl_symbol_id(FuncDecl);
+  if (func_id != 0) {
+    symbols_.add_symbol(func_id, func_name,
+                        FuncDecl->getQualifiedNameAsString(), file_path,
+                        start_line_no, end_line_no);
+  }
 
-  construct_callgraph(FuncDecl, func_entry);
+  // The body is traversed after this, so its calls are added for this
+  // function.
+  caller_.decl = FuncDecl;
+  caller_.file_path = file_path;
+  caller_.name = func_name;
+  caller_.id = func_id;
   return true;
 }
 
-void CodeDataVisitor::construct_callgraph(clang::FunctionDecl *FuncDecl,
-                                          Json::Value         &func_entry) {
-  clang::CallGraphNode *node = CG_.getOrInsertNode(FuncDecl);
-  if (node == nullptr) { return; }
-
-  const std::string func_name = FuncDecl->getNameInfo().getName().getAsString();
-  for (clang::CallGraphNode::CallRecord callee : node->callees()) {
-    clang::Expr *callee_expr = callee.CallExpr;
-    if (callee_expr == nullptr) { continue; }
-
-    // Callexpr
-    if (clang::isa<clang::CallExpr>(callee_expr)) {
-      clang::CallExpr *call_expr = clang::cast<clang::CallExpr>(callee_expr);
-      clang::FunctionDecl *callee_func =
-          call_expr->getDirectCallee();  // Get the callee function
-
-      if (callee_func == nullptr) {
-        llvm::outs() << "Skip indirect call expression : ";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
-
-      const std::string callee_name =
-          callee_func->getNameInfo().getName().getAsString();
+bool CodeDataVisitor::VisitCallExpr(clang::CallExpr *CallExpr) {
+  if (caller_.decl == nullptr) { return true; }
 
-      if (callee_name.empty()) {
-        llvm::outs() << "Skip empty callee name in call expression : ";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
+  // Calls that depend on template parameters are only resolved when the
+  // template is instantiated.
+  if (CallExpr->isTypeDependent()) {
+    skip_call(Diagnostic::DEPENDENT_CALL,
+              [&]() { return describe_expr(CallExpr); });
+    return true;
+  }
 
-      clang::SourceLocation callee_loc = callee_func->getBeginLoc();
+  // Member calls, operator calls and explicit destructor calls have a direct
+  // callee as well.
+  const clang::FunctionDecl *callee_func = CallExpr->getDirectCallee();
+  if (callee_func == nullptr) {
+    skip_call(Diagnostic::INDIRECT_CALL,
+              [&]() { return describe_expr(CallExpr); });
+    return true;
+  }
 
-      if (callee_loc.isMacroID()) {
-        callee_loc = src_manager_.getSpellingLoc(callee_loc);
-      }
+  add_callee(callee_func);
+  return true;
+}
 
-      llvm::StringRef callee_file_name = src_manager_.getFilename(callee_loc);
-      if (is_system_file(callee_file_name.str())) {
-        // Skip system files
-        continue;
-      }
+bool CodeDataVisitor::VisitCXXConstructExpr(
+    clang::CXXConstructExpr *ConstructExpr) {
+  if (caller_.decl == nullptr) { return true; }
 
-      add_callee(func_name, callee_func, func_entry);
-      continue;
-    }
-
-    // Binary operator
-    if (clang::isa<clang::BinaryOperator>(callee_expr)) {
-      clang::BinaryOperator *bin_op =
-          clang::cast<clang::BinaryOperator>(callee_expr);
+  add_callee(ConstructExpr->getConstructor());
+  return true;
+}
 
-      clang::BinaryOperatorKind bin_op_kind = bin_op->getOpcode();
+bool CodeDataVisitor::VisitCXXNewExpr(clang::CXXNewExpr *NewExpr) {
+  if (caller_.decl == nullptr) { return true; }
 
-      llvm::outs() << "Skip binary operator in call expression : "
-                   << clang::BinaryOperator::getOpcodeStr(bin_op_kind)
-                   << " in function: " << func_name << ", Callee: ";
-      callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-      llvm::outs() << "\n";
-      continue;
-    }
+  // The constructor is a CXXConstructExpr of its own.
+  add_callee(NewExpr->getOperatorNew());
+  return true;
+}
 
-    // CXXConstructExpr
-    if (clang::isa<clang::CXXConstructExpr>(callee_expr)) {
-      clang::CXXConstructExpr *cxx_construct_expr =
-          clang::cast<clang::CXXConstructExpr>(callee_expr);
+bool CodeDataVisitor::VisitCXXDeleteExpr(clang::CXXDeleteExpr *DeleteExpr) {
+  if (caller_.decl == nullptr) { return true; }
 
-      clang::CXXConstructorDecl *ctor_decl =
-          cxx_construct_expr->getConstructor();
+  add_destructor_callee(DeleteExpr->getDestroyedType());
+  add_callee(DeleteExpr->getOperatorDelete());
+  return true;
+}
 
-      if (ctor_decl == nullptr) {
-        llvm::outs() << "Skip null constructor in call expression : ";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
+// Temporaries are destroyed at the end of the full expression.
+bool CodeDataVisitor::VisitCXXBindTemporaryExpr(
+    clang::CXXBindTemporaryExpr *BindExpr) {
+  if (caller_.decl == nullptr) { return true; }
 
-      const std::string callee_name =
-          ctor_decl->getNameInfo().getName().getAsString();
+  add_callee(BindExpr->getTemporary()->getDestructor());
+  return true;
+}
 
-      if (callee_name.empty()) {
-        llvm::outs() << "Skip empty callee name in CXXConstructExpr : ";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
+void CodeDataVisitor::add_destructor_callee(clang::QualType type) {
+  if (type.isNull() || type->isDependentType()) { return; }
 
-      const clang::SourceLocation callee_loc = callee_expr->getBeginLoc();
-      llvm::StringRef callee_file_name = src_manager_.getFilename(callee_loc);
-      if (is_system_file(callee_file_name.str())) {
-        // Skip system files
-        continue;
-      }
+  const clang::CXXRecordDecl *record =
+      type->getBaseElementTypeUnsafe()->getAsCXXRecordDecl();
+  if (record == nullptr || !record->hasDefinition() ||
+      record->hasTrivialDestructor()) {
+    return;
+  }
 
-      add_callee(func_name, ctor_decl, func_entry);
-      continue;
-    }
+  add_callee(record->getDestructor());
+  return;
+}
 
-    // CXXMemberCallExpr
-    if (clang::isa<clang::CXXMemberCallExpr>(callee_expr)) {
-      clang::CXXMemberCallExpr *member_call_expr =
-          clang::cast<clang::CXXMemberCallExpr>(callee_expr);
-      clang::Expr *implicit_obj_arg =
-          member_call_expr->getImplicitObjectArgument();
-      if (implicit_obj_arg == nullptr) {
-        llvm::outs()
-            << "Skip null implicit object argument in CXXMemberCallExpr :";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
-      clang::CXXMethodDecl *method_decl =
-          member_call_expr->getMethodDecl();  // Get the method declaration
-      if (method_decl == nullptr) {
-        llvm::outs() << "Skip null method declaration in CXXMemberCallExpr : ";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
-      const std::string callee_name =
-          method_decl->getNameInfo().getName().getAsString();
-      if (callee_name.empty()) {
-        llvm::outs() << "Skip empty callee name in CXXMemberCallExpr :";
-        callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-        llvm::outs() << "\n";
-        continue;
-      }
+// Counts a call that is not turned into an edge. Only the samples are
+// described, unless every skipped call is logged with -v.
+void CodeDataVisitor::skip_call(Diagnostic                         diag,
+                                llvm::function_ref<std::string()> describe) {
+  const bool sample = diagnostics_.count(diag);
+  if (!sample && !verbose_) { return; }
+
+  std::string description = describe();
+  if (verbose_) {
+    log_ << "Skip " << get_diagnostic_name(diag) << " in function "
+         << caller_.name << " : " << description << "\n";
+  }
+  if (sample) { diagnostics_.add_sample(diag, std::move(description)); }
+  return;
+}
 
-      const clang::SourceLocation callee_loc = callee_expr->getBeginLoc();
-      llvm::StringRef callee_file_name = src_manager_.getFilename(callee_loc);
-      if (is_system_file(callee_file_name.str())) {
-        // Skip system files
-        continue;
-      }
+// "<file>:<line>: <expression>"
+std::string CodeDataVisitor::describe_expr(const clang::Expr *expr) {
+  std::string              description;
+  llvm::raw_string_ostream description_stream(description);
+  description_stream << caller_.file_path << ":"
+                     << src_manager_.getSpellingLineNumber(expr->getBeginLoc())
+                     << ": ";
+  expr->printPretty(description_stream, nullptr, lang_opts_);
+  description_stream.flush();
+  return description;
+}
 
-      add_callee(func_name, method_decl, func_entry);
-      continue;
-    }
+// Adds the edges between the function being traversed and callee_decl,
+// unless callee_decl is declared in a system file.
+void CodeDataVisitor::add_callee(const clang::FunctionDecl *callee_decl) {
+  if (callee_decl == nullptr) { return; }
 
-    llvm::outs() << "else case : Function: " << func_name << ", Callee: ";
-    callee_expr->printPretty(llvm::outs(), nullptr, lang_opts_);
-    llvm::outs() << "\n";
+  clang::SourceLocation callee_loc = callee_decl->getBeginLoc();
+  if (callee_loc.isMacroID()) {
+    callee_loc = src_manager_.getSpellingLoc(callee_loc);
+  }
+  if (system_filter_.is_system_loc(callee_loc)) {
+    skip_call(Diagnostic::SYSTEM_CALLEE,
+              [&]() { return callee_decl->getQualifiedNameAsString(); });
+    return;
   }
-  return;
-}
 
-void CodeDataVisitor::add_callee(const std::string   &func_name,
-                                 clang::FunctionDecl *callee_decl,
-                                 Json::Value         &caller_entry) {
   const std::string callee_name =
       callee_decl->getNameInfo().getName().getAsString();
+  if (callee_name.empty()) { return; }
 
-  if (!caller_entry.isMember("callees")) {
-    caller_entry["callees"] = Json::Value(Json::arrayValue);
-  }
+  model_.add_callee(caller_.file_path, caller_.name, callee_name);
 
-  Json::Value &callees_array = caller_entry["callees"];
-
-  if (!contains_string(callees_array, callee_name)) {
-    callees_array.append(callee_name);
+  const SymbolID callee_id = get_decl_symbol_id(callee_decl);
+  if (caller_.id != 0 && callee_id != 0) {
+    symbols_.add_symbol(callee_id, callee_name,
+                        callee_decl->getQualifiedNameAsString());
+    symbols_.add_call(caller_.id, callee_id);
   }
 
-  clang::FunctionDecl *callee_def = callee_decl->getDefinition();
+  const clang::FunctionDecl *callee_def = callee_decl->getDefinition();
   if (callee_def == nullptr) { return; }
 
   clang::SourceLocation loc = callee_def->getLocation();
   llvm::StringRef       callee_file_name = src_manager_.getFilename(loc);
   if (callee_file_name == "") { return; }
 
-  const std::string callee_file_path =
-      get_canonical_abs_path(callee_file_name.str());
+  if (system_filter_.is_system_loc(loc)) { return; }
 
-  if (is_system_file(callee_file_path)) { return; }
-
-  ensure_file_key(output_json_, callee_file_path);
-
-  collect_disabled_macros(output_json_, callee_file_path);
-
-  Json::Value &callee_file_entry = output_json_[callee_file_path];
-  Json::Value &functions_entry = callee_file_entry["functions"];
-
-  ensure_key(functions_entry, callee_name);
-
-  Json::Value &callee_entry = functions_entry[callee_name];
-
-  if (!callee_entry.isMember("callers")) {
-    callee_entry["callers"] = Json::Value(Json::arrayValue);
-  }
+  const std::string callee_file_path =
+      get_canonical_abs_path(callee_file_name.str(), working_dir_);
 
-  Json::Value &callers_array = callee_entry["callers"];
-  if (contains_string(callers_array, func_name)) { return; }
-  callee_entry["callers"].append(func_name);
+  model_.add_caller(callee_file_path, callee_name, caller_.name);
   return;
 }
 
 bool CodeDataVisitor::VisitVarDecl(clang::VarDecl *VarDecl) {
+  // Local variables are destroyed at the end of their scope.
+  if (caller_.decl != nullptr && VarDecl->hasLocalStorage() &&
+      !clang::isa<clang::ParmVarDecl>(VarDecl)) {
+    add_destructor_callee(VarDecl->getType());
+  }
+
   const std::string var_name = VarDecl->getNameAsString();
   if (var_name == "") { return true; }
 
   clang::SourceLocation loc = VarDecl->getLocation();
   llvm::StringRef       file_name = src_manager_.getFilename(loc);
-  const std::string     file_path = get_canonical_abs_path(file_name.str());
+  const std::string     file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   if (file_path.empty()) {
     // Skip if the file path is empty
     return true;
   }
 
-  if (is_system_file(file_path)) {
-    // Skip system files
-    return true;
-  }
-
-  ensure_file_key(output_json_, file_path);
-  collect_disabled_macros(output_json_, file_path);
-
-  Json::Value &file_entry = output_json_[file_path];
+  // The file is listed even if the variable is not recorded below, such as a
+  // parameter of a function declaration.
+  model_.add_file(file_path);
 
   // get variable initialization source code
   clang::SourceLocation start_loc = VarDecl->getBeginLoc();
@@ -393,29 +397,16 @@ bool CodeDataVisitor::VisitVarDecl(clang::VarDecl *VarDecl) {
 
     if (!func_decl->isThisDeclarationADefinition()) { return true; }
 
-    Json::Value      &functions_entry = output_json_[file_path]["functions"];
     const std::string func_name =
         func_decl->getNameInfo().getName().getAsString();
 
-    ensure_key(functions_entry, func_name);
-    Json::Value &func_entry = functions_entry[func_name];
-    ensure_key(func_entry, "variables");
-    Json::Value &variables_entry = func_entry["variables"];
-    ensure_key(variables_entry, var_name);
-    Json::Value &var_entry = variables_entry[var_name];
-    var_entry["definition"] = src_code;
-    var_entry["start_line"] = start_line_no;
-    var_entry["end_line"] = end_line_no;
+    model_.set_variable(file_path, func_name, var_name, src_code,
+                        start_line_no, end_line_no);
     return true;
   }
 
-  ensure_key(file_entry, "global_variables");
-  Json::Value &global_vars_entry = file_entry["global_variables"];
-  ensure_key(global_vars_entry, var_name);
-  Json::Value &var_info = global_vars_entry[var_name];
-  var_info["definition"] = src_code;
-  var_info["start_line"] = start_line_no;
-  var_info["end_line"] = end_line_no;
+  model_.set_record(CodeModel::RecordKind::GLOBAL_VARIABLE, file_path,
+                    var_name, src_code, start_line_no, end_line_no);
   return true;
 }
 
@@ -425,25 +416,14 @@ bool CodeDataVisitor::VisitTypedefDecl(clang::TypedefDecl *TypedefDecl) {
 
   clang::SourceLocation loc = TypedefDecl->getLocation();
   llvm::StringRef       file_name = src_manager_.getFilename(loc);
-  const std::string     file_path = get_canonical_abs_path(file_name.str());
+  const std::string     file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   if (file_path.empty()) {
     // Skip if the file path is empty
     return true;
   }
 
-  if (is_system_file(file_path)) {
-    // Skip system files
-    return true;
-  }
-
-  ensure_file_key(output_json_, file_path);
-
-  collect_disabled_macros(output_json_, file_path);
-
-  Json::Value &file_entry = output_json_[file_path];
-  Json::Value &types_entry = file_entry["types"];
-
   // get typedef source code
   clang::SourceLocation start_loc = TypedefDecl->getBeginLoc();
   clang::SourceLocation end_loc = TypedefDecl->getEndLoc();
@@ -456,12 +436,8 @@ bool CodeDataVisitor::VisitTypedefDecl(clang::TypedefDecl *TypedefDecl) {
   const int32_t start_line_no = src_manager_.getSpellingLineNumber(start_loc);
   const int32_t end_line_no = src_manager_.getSpellingLineNumber(end_loc);
 
-  ensure_key(types_entry, typedef_name);
-
-  Json::Value &typedef_info = types_entry[typedef_name];
-  typedef_info["definition"] = src_code;
-  typedef_info["start_line"] = start_line_no;
-  typedef_info["end_line"] = end_line_no;
+  model_.set_record(CodeModel::RecordKind::TYPE, file_path, typedef_name,
+                    src_code, start_line_no, end_line_no);
 
   return true;
 }
@@ -472,21 +448,14 @@ bool CodeDataVisitor::VisitRecordDecl(clang::RecordDecl *RecordDecl) {
 
   clang::SourceLocation loc = RecordDecl->getLocation();
   llvm::StringRef       file_name = src_manager_.getFilename(loc);
-  const std::string     file_path = get_canonical_abs_path(file_name.str());
+  const std::string     file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   if (file_path.empty()) {
     // Skip if the file path is empty
     return true;
   }
 
-  if (is_system_file(file_path)) {
-    // Skip system files
-    return true;
-  }
-
-  ensure_file_key(output_json_, file_path);
-  collect_disabled_macros(output_json_, file_path);
-
   // get record source code
   clang::SourceLocation start_loc = RecordDecl->getBeginLoc();
   clang::SourceLocation end_loc = RecordDecl->getEndLoc();
@@ -499,15 +468,8 @@ bool CodeDataVisitor::VisitRecordDecl(clang::RecordDecl *RecordDecl) {
   const int32_t start_line_no = src_manager_.getSpellingLineNumber(start_loc);
   const int32_t end_line_no = src_manager_.getSpellingLineNumber(end_loc);
 
-  Json::Value &file_entry = output_json_[file_path];
-  Json::Value &records_entry = file_entry["types"];
-
-  ensure_key(records_entry, record_name);
-
-  Json::Value &record_info = records_entry[record_name];
-  record_info["definition"] = src_code;
-  record_info["start_line"] = start_line_no;
-  record_info["end_line"] = end_line_no;
+  model_.set_record(CodeModel::RecordKind::TYPE, file_path, record_name,
+                    src_code, start_line_no, end_line_no);
 
   return true;
 }
@@ -518,21 +480,14 @@ bool CodeDataVisitor::VisitEnumDecl(clang::EnumDecl *EnumDecl) {
 
   clang::SourceLocation loc = EnumDecl->getLocation();
   llvm::StringRef       file_name = src_manager_.getFilename(loc);
-  const std::string     file_path = get_canonical_abs_path(file_name.str());
+  const std::string     file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   if (file_path.empty()) {
     // Skip if the file path is empty
     return true;
   }
 
-  if (is_system_file(file_path)) {
-    // Skip system files
-    return true;
-  }
-
-  ensure_file_key(output_json_, file_path);
-  collect_disabled_macros(output_json_, file_path);
-
   // get enum source code
   clang::SourceLocation start_loc = EnumDecl->getBeginLoc();
   clang::SourceLocation end_loc = EnumDecl->getEndLoc();
@@ -545,15 +500,8 @@ bool CodeDataVisitor::VisitEnumDecl(clang::EnumDecl *EnumDecl) {
   const int32_t start_line_no = src_manager_.getSpellingLineNumber(start_loc);
   const int32_t end_line_no = src_manager_.getSpellingLineNumber(end_loc);
 
-  Json::Value &file_entry = output_json_[file_path];
-  Json::Value &enums_entry = file_entry["enums"];
-
-  ensure_key(enums_entry, enum_name);
-
-  Json::Value &enum_info = enums_entry[enum_name];
-  enum_info["definition"] = src_code;
-  enum_info["start_line"] = start_line_no;
-  enum_info["end_line"] = end_line_no;
+  model_.set_record(CodeModel::RecordKind::ENUM, file_path, enum_name,
+                    src_code, start_line_no, end_line_no);
 
   return true;
 }
@@ -562,9 +510,8 @@ bool CodeDataVisitor::VisitEnumDecl(clang::EnumDecl *EnumDecl) {
 // CodeDataASTConsumer class
 // ////////////////////////
 void CodeDataASTConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
-  clang::TranslationUnitDecl *tu_decl = Context.getTranslationUnitDecl();
-  CG_.addToCallGraph(tu_decl);
-  Visitor.TraverseDecl(tu_decl);
+  llvm::TimeTraceScope trace_scope("TraverseAST");
+  Visitor.TraverseDecl(Context.getTranslationUnitDecl());
 }
 
 // ////////////////////////
@@ -575,12 +522,38 @@ std::unique_ptr<clang::ASTConsumer> CodeDataFrontendAction::CreateASTConsumer(
   clang::SourceManager &source_manager = CI.getSourceManager();
   clang::LangOptions   &lang_opts = CI.getLangOpts();
 
-  return std::make_unique<CodeDataASTConsumer>(source_manager, lang_opts,
-                                               output_json_);
+  system_filter_ =
+      std::make_unique<SystemFileFilter>(source_manager, working_dir_);
+
+  dependency_collector_ = std::make_shared<AllDependencyCollector>();
+  dependency_collector_->attachToPreprocessor(CI.getPreprocessor());
+
+  // Macros are collected during the same preprocessing pass that builds the
+  // AST, so each translation unit is only preprocessed once.
+  CI.getPreprocessor().addPPCallbacks(std::make_unique<MacroPrinter>(
+      source_manager, lang_opts, tu_output_.model, working_dir_,
+      *system_filter_, header_filter_, exact_disabled_macros_));
+
+  return std::make_unique<CodeDataASTConsumer>(
+      source_manager, lang_opts, tu_output_.model, working_dir_, log_,
+      *system_filter_, header_filter_, tu_output_.symbols,
+      tu_output_.diagnostics, verbose_);
 }
 
 void CodeDataFrontendAction::ExecuteAction() {
   clang::ASTFrontendAction::ExecuteAction();
+
+  if (dependency_collector_ != nullptr) {
+    for (const std::string &file_name :
+         dependency_collector_->getDependencies()) {
+      const std::string file_path =
+          get_canonical_abs_path(file_name, working_dir_);
+      if (file_path.empty()) { continue; }
+      tu_output_.dependencies.push_back(file_path);
+    }
+  }
+
+  if (header_filter_.skipped_any()) { tu_output_.cacheable = false; }
   return;
 }
 
@@ -590,10 +563,18 @@ void CodeDataFrontendAction::ExecuteAction() {
 
 MacroPrinter::MacroPrinter(clang::SourceManager &src_manager,
                            clang::LangOptions   &lang_opts,
-                           Json::Value          &output_json)
+                           CodeModel            &model,
+                           const std::string    &working_dir,
+                           SystemFileFilter     &system_filter,
+                           HeaderFilter         &header_filter,
+                           bool                  exact_disabled_macros)
     : src_manager_(src_manager),
       lang_opts_(lang_opts),
-      output_json_(output_json) {
+      model_(model),
+      working_dir_(working_dir),
+      system_filter_(system_filter),
+      header_filter_(header_filter),
+      exact_disabled_macros_(exact_disabled_macros) {
 }
 
 void MacroPrinter::MacroDefined(const clang::Token          &MacroNameTok,
@@ -601,15 +582,14 @@ void MacroPrinter::MacroDefined(const clang::Token          &MacroNameTok,
   const clang::MacroInfo *MI = MD->getMacroInfo();
 
   clang::SourceLocation loc = MacroNameTok.getLocation();
-  llvm::StringRef       file_name = src_manager_.getFilename(loc);
-
-  if (file_name.empty()) { return; }
-  const std::string file_path = get_canonical_abs_path(file_name.str());
+  if (system_filter_.is_system_loc(loc)) { return; }
+  if (header_filter_.is_harvested_elsewhere(src_manager_, loc)) { return; }
 
-  if (is_system_file(file_path)) { return; }
+  llvm::StringRef file_name = src_manager_.getFilename(loc);
 
-  ensure_file_key(output_json_, file_path);
-  collect_disabled_macros(output_json_, file_path);
+  if (file_name.empty()) { return; }
+  const std::string file_path =
+      get_canonical_abs_path(file_name.str(), working_dir_);
 
   const std::string macro_name =
       MacroNameTok.getIdentifierInfo()->getName().str();
@@ -625,244 +605,719 @@ void MacroPrinter::MacroDefined(const clang::Token          &MacroNameTok,
   const int32_t start_line_no = src_manager_.getSpellingLineNumber(DefBegin);
   const int32_t end_line_no = src_manager_.getSpellingLineNumber(DefEnd);
 
-  Json::Value &file_entry = output_json_[file_path];
-  Json::Value &macros_entry = file_entry["macros"];
+  model_.set_record(CodeModel::RecordKind::MACRO, file_path, macro_name, def,
+                    start_line_no, end_line_no);
+  return;
+}
+
+// Canonical path of the file of loc, or "" if its declarations and macros are
+// not harvested by this translation unit.
+std::string MacroPrinter::get_file_path(clang::SourceLocation loc) {
+  if (system_filter_.is_system_loc(loc)) { return ""; }
+  if (header_filter_.is_harvested_elsewhere(src_manager_, loc)) { return ""; }
 
-  ensure_key(macros_entry, macro_name);
-  Json::Value &macro_info = macros_entry[macro_name];
+  clang::OptionalFileEntryRef file_ref =
+      src_manager_.getFileEntryRefForID(src_manager_.getFileID(loc));
+  if (!file_ref) { return ""; }
 
-  macro_info["definition"] = def;
-  macro_info["start_line"] = start_line_no;
-  macro_info["end_line"] = end_line_no;
+  return get_canonical_abs_path(file_ref->getName().str(), working_dir_);
+}
+
+void MacroPrinter::FileChanged(clang::SourceLocation                Loc,
+                               clang::PPCallbacks::FileChangeReason Reason,
+                               clang::SrcMgr::CharacteristicKind    FileType,
+                               clang::FileID                        PrevFID) {
+  if (!exact_disabled_macros_) { return; }
+  if (Reason != clang::PPCallbacks::EnterFile) { return; }
+
+  const std::string file_path = get_file_path(Loc);
+  if (file_path.empty()) { return; }
+  model_.set_preprocessed(file_path);
+  return;
+}
+
+// Strips each line of text and joins the lines with "\n", the format of
+// definitions in "disabled_macros".
+static std::string join_stripped_lines(llvm::StringRef text) {
+  std::string joined;
+  while (true) {
+    const std::pair<llvm::StringRef, llvm::StringRef> lines = text.split('\n');
+    joined += strip(lines.first.str());
+    if (lines.second.data() == nullptr) { break; }
+    text = lines.second;
+    joined += "\n";
+  }
+  return joined;
+}
+
+// Lexes the skipped range the same way the preprocessor skips it, so comments
+// and string literals are honored, and records the #define directives in it.
+void MacroPrinter::SourceRangeSkipped(clang::SourceRange    Range,
+                                      clang::SourceLocation EndifLoc) {
+  if (!exact_disabled_macros_) { return; }
+
+  const clang::SourceLocation begin_loc = Range.getBegin();
+  if (!begin_loc.isFileID()) { return; }
+
+  const std::string file_path = get_file_path(begin_loc);
+  if (file_path.empty()) { return; }
+
+  const clang::FileID file_id = src_manager_.getFileID(begin_loc);
+  bool                invalid = false;
+  llvm::StringRef     buffer = src_manager_.getBufferData(file_id, &invalid);
+  if (invalid) { return; }
+
+  const size_t begin_offset = src_manager_.getFileOffset(begin_loc);
+  const size_t end_offset =
+      std::min<size_t>(src_manager_.getFileOffset(Range.getEnd()),
+                       buffer.size());
+
+  // The lexer needs the NUL-terminated end of the buffer, so the end of the
+  // range is checked for each token instead.
+  clang::Lexer lexer(src_manager_.getLocForStartOfFile(file_id), lang_opts_,
+                     buffer.begin(), buffer.begin() + begin_offset,
+                     buffer.end());
+  clang::Token token;
+
+  auto lex = [&]() {
+    lexer.LexFromRawLexer(token);
+    if (src_manager_.getFileOffset(token.getLocation()) >= end_offset) {
+      token.setKind(clang::tok::eof);
+    }
+  };
+
+  lex();
+  while (token.isNot(clang::tok::eof)) {
+    if (token.isNot(clang::tok::hash) || !token.isAtStartOfLine()) {
+      lex();
+      continue;
+    }
+
+    const clang::SourceLocation hash_loc = token.getLocation();
+    lex();
+    if (token.isNot(clang::tok::raw_identifier) || token.isAtStartOfLine() ||
+        token.getRawIdentifier() != "define") {
+      continue;
+    }
+
+    lex();
+    if (token.isNot(clang::tok::raw_identifier) || token.isAtStartOfLine()) {
+      continue;
+    }
+    const std::string macro_name = token.getRawIdentifier().str();
+
+    // The directive ends with the last token before the next line.
+    clang::SourceLocation last_loc = token.getLocation();
+    lex();
+    while (token.isNot(clang::tok::eof) && !token.isAtStartOfLine()) {
+      last_loc = token.getLocation();
+      lex();
+    }
+
+    const size_t hash_offset = src_manager_.getFileOffset(hash_loc);
+    size_t       line_begin = buffer.rfind('\n', hash_offset);
+    line_begin = line_begin == llvm::StringRef::npos ? 0 : line_begin + 1;
+    const size_t line_end = std::min(
+        buffer.find('\n', src_manager_.getFileOffset(last_loc)), buffer.size());
+
+    // Line numbers follow the textual scan: start_line is one less than the
+    // line of the #define.
+    model_.add_disabled_macro(
+        file_path, macro_name,
+        join_stripped_lines(buffer.slice(line_begin, line_end)),
+        static_cast<int32_t>(src_manager_.getSpellingLineNumber(hash_loc)) - 1,
+        static_cast<int32_t>(src_manager_.getSpellingLineNumber(last_loc)));
+  }
   return;
 }
 
 // ////////////////////////
-// MacroAction class
+// // main function
 // ////////////////////////
 
-MacroAction::MacroAction(Json::Value &output_json) : output_json_(output_json) {
+// Converts the model to JSON and hands it to the writer one file at a time,
+// so that neither the JSON of every file nor the serialized output is ever
+// held in memory as a whole.
+template <typename Writer>
+static size_t write_file_entries(Writer &writer, const CodeModel &model,
+                                 bool is_shard) {
+  for (const std::string &file_path : model.get_file_paths()) {
+    writer.write_file_entry(file_path, model.to_json(file_path, is_shard));
+  }
+  writer.finish();
+  return writer.get_num_entries();
 }
 
-void MacroAction::ExecuteAction() {
-  clang::CompilerInstance &CI = getCompilerInstance();
-  clang::Preprocessor     &PP = CI.getPreprocessor();
-  clang::SourceManager    &SM = PP.getSourceManager();
-  clang::LangOptions      &lang_opts = CI.getLangOpts();
+static void write_output(const char *output_filename, const CodeModel &model,
+                         OutputFormat format, bool compact, bool is_shard) {
+  llvm::TimeTraceScope trace_scope("WriteOutput", output_filename);
 
-  PP.addPPCallbacks(
-      std::make_unique<MacroPrinter>(SM, lang_opts, output_json_));
+  std::ofstream output_file(output_filename, std::ios::binary);
+  if (!output_file.is_open()) {
+    std::cerr << "Error: could not open output file " << output_filename
+              << "\n";
+    return;
+  }
 
-  PP.EnterMainSourceFile();
-  clang::Token Tok;
+  size_t num_files = 0;
+  if (format == OutputFormat::BINARY) {
+    BinaryCodeDataWriter writer(output_file);
+    num_files = write_file_entries(writer, model, is_shard);
+  } else {
+    CodeDataWriter writer(output_file, format, compact);
+    num_files = write_file_entries(writer, model, is_shard);
+  }
 
-  do {
-    PP.Lex(Tok);
-  } while (Tok.isNot(clang::tok::eof));
+  output_file.close();
+  std::cout << "Wrote code data to " << output_filename << "\n";
+  std::cout << "Total files found: " << num_files << "\n";
+  return;
+}
+
+static void write_symbol_index(const std::string &index_filename,
+                               const SymbolIndex &symbols, bool compact) {
+  llvm::TimeTraceScope trace_scope("WriteSymbolIndex", index_filename);
+
+  std::ofstream index_file(index_filename, std::ios::binary);
+  if (!index_file.is_open()) {
+    std::cerr << "Error: could not open symbol index file " << index_filename
+              << "\n";
+    return;
+  }
 
-  remove_enabled_macros();
+  Json::StreamWriterBuilder writer_builder;
+  writer_builder["indentation"] = compact ? "" : "\t";
+  std::unique_ptr<Json::StreamWriter> writer(writer_builder.newStreamWriter());
+  writer->write(symbols.to_json(), &index_file);
+  index_file << "\n";
 
+  index_file.close();
+  std::cout << "Wrote " << symbols.get_num_symbols() << " symbols and "
+            << symbols.get_num_calls() << " calls to " << index_filename
+            << "\n";
   return;
 }
 
-void MacroAction::remove_enabled_macros() {
-  for (const std::string &file_name : output_json_.getMemberNames()) {
-    Json::Value &enabled_macros = output_json_[file_name]["macros"];
-    Json::Value &disabled_macros = output_json_[file_name]["disabled_macros"];
+static void write_diagnostics(const std::string        &diag_filename,
+                              const DiagnosticCounters &diagnostics) {
+  std::ofstream diag_file(diag_filename, std::ios::binary);
+  if (!diag_file.is_open()) {
+    std::cerr << "Error: could not open diagnostics file " << diag_filename
+              << "\n";
+    return;
+  }
 
-    for (const std::string &macro_name : disabled_macros.getMemberNames()) {
-      if (!enabled_macros.isMember(macro_name)) { continue; }
-      const std::string &enabled_def =
-          enabled_macros[macro_name]["definition"].asString();
+  diag_file << diagnostics.to_json().toStyledString();
+  diag_file.close();
+  std::cout << "Wrote diagnostics to " << diag_filename << "\n";
+  return;
+}
 
-      Json::Value &disabled_defs = disabled_macros[macro_name];
+// Hash of the parts of a compile command that affect how headers are parsed.
+// Output and dependency file options are ignored, so that the translation
+// units of one target share the same configuration. Macros defined in the
+// source itself are not seen here.
+static uint64_t get_config_hash(const CompileCommand &cmd) {
+  std::string config = cmd.working_dir_;
+  config += '\0';
+  config += fs::path(cmd.src_file_).extension().string();
+
+  for (const std::string &arg : normalize_compile_args(cmd.command_)) {
+    config += '\0';
+    config += arg;
+  }
 
-      Json::Value remained = Json::Value(Json::arrayValue);
+  return llvm::xxh3_64bits(config);
+}
 
-      for (const Json::Value &disabled_def : disabled_defs) {
-        const std::string disabled_str = disabled_def["definition"].asString();
+// Settings and state shared by all translation units of one run.
+struct ExtractionContext {
+  uint32_t        num_jobs = 1;
+  HeaderRegistry *header_registry = nullptr;
+  TUCache        *cache = nullptr;
+  bool            exact_disabled_macros = false;
+  bool            trace = false;
+  bool            verbose = false;
+};
+
+// Events shorter than this are not recorded, as in clang's -ftime-trace.
+static const uint32_t TRACE_GRANULARITY_US = 500;
+// Translation units each -j worker may parse ahead of the merge.
+static const uint32_t MAX_PENDING_PER_JOB = 4;
+// Upper bound of -j, since each job is a thread.
+static const uint32_t MAX_JOBS = 1024;
+
+static void run_compile_command(const CompileCommand    &cmd,
+                                const ExtractionContext &ctx,
+                                TUOutput                &tu_output) {
+  llvm::TimeTraceScope trace_scope("TranslationUnit", cmd.src_file_);
+
+  const std::string              &src_path = cmd.src_file_;
+  const std::vector<std::string> &compile_args = cmd.command_;
+  std::ifstream                   src_file(src_path);
+  if (!src_file.is_open()) {
+    std::cerr << "Failed to open source file: " << src_path << "\n";
+    return;
+  }
 
-        if (disabled_str == enabled_def) { continue; }
-        remained.append(disabled_def);
-      }
+  const std::string &working_dir = cmd.working_dir_;
+  if (!fs::exists(working_dir)) {
+    std::cerr << "Warning: working directory does not exist: " << working_dir
+              << "for source file: " << src_path << "\n";
+    return;
+  }
 
-      disabled_macros[macro_name] = remained;
-    }
+  std::stringstream src_buffer;
+  src_buffer << src_file.rdbuf();
+  src_file.close();
 
-    Json::Value remained = Json::Value(Json::objectValue);
+  const std::string src_code = src_buffer.str();
+  const uint64_t    config_hash = get_config_hash(cmd);
 
-    for (const std::string &macro_name : disabled_macros.getMemberNames()) {
-      Json::Value &disabled_defs = disabled_macros[macro_name];
-      if (disabled_defs.size() == 0) { continue; }
-      remained[macro_name] = disabled_defs;
+  bool cache_hit = false;
+  if (ctx.cache != nullptr) {
+    llvm::TimeTraceScope trace_scope("LoadCache", src_path);
+    cache_hit = ctx.cache->load(cmd, src_code, tu_output);
+  }
+  if (cache_hit) {
+    // Headers of a cached translation unit count as harvested as well.
+    if (ctx.header_registry != nullptr) {
+      for (const std::string &file_path : tu_output.dependencies) {
+        uint64_t content_hash = 0;
+        if (!ctx.cache->get_file_hash(file_path, content_hash)) { continue; }
+        ctx.header_registry->claim(file_path, content_hash, config_hash);
+      }
     }
-
-    output_json_[file_name]["disabled_macros"] = remained;
+    return;
   }
-  return;
-}
 
-// ////////////////////////
-// // main function
-// ////////////////////////
+  // Each translation unit gets its own file system view rooted at its working
+  // directory, instead of changing the working directory of the process.
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system(
+      llvm::vfs::createPhysicalFileSystem().release());
+  if (file_system->setCurrentWorkingDirectory(working_dir)) {
+    std::cerr << "Warning: could not change to working directory: "
+              << working_dir << " for source file: " << src_path << "\n";
+    return;
+  }
 
-static std::vector<CompileCommand> read_compile_commands(
-    const char *compile_commands_path) {
-  static const std::set<std::string> src_extensions = {".c", ".cc", ".cpp",
-                                                       ".cxx"};
+  llvm::raw_string_ostream log(tu_output.log);
+
+  // Clang's own time trace sections, e.g. for each header and template
+  // instantiation, are recorded under this one.
+  bool success = false;
+  {
+    llvm::TimeTraceScope trace_scope("Parse", src_path);
+    success = clang::tooling::runToolOnCodeWithArgs(
+        std::make_unique<CodeDataFrontendAction>(
+            tu_output, working_dir, log, ctx.header_registry, config_hash,
+            ctx.exact_disabled_macros, ctx.verbose),
+        src_code, file_system, compile_args, src_path);
+  }
+  log.flush();
 
-  std::vector<CompileCommand> commands{};
+  // Calls repeated within the translation unit are dropped before it is
+  // cached and merged.
+  tu_output.symbols.finalize();
 
-  std::ifstream cc_file(compile_commands_path);
+  if (!success) { tu_output.cacheable = false; }
 
-  if (!cc_file.is_open()) {
-    std::cerr << "Error: could not open compile commands file "
-              << compile_commands_path << "\n";
-    return {};
+  if (ctx.cache != nullptr && tu_output.cacheable) {
+    llvm::TimeTraceScope trace_scope("StoreCache", src_path);
+    ctx.cache->store(cmd, src_code, tu_output);
   }
+}
 
-  std::string line;
-  while (std::getline(cc_file, line)) {
-    if (line.empty()) { continue; }
+// Merge the output of one translation unit into the final output. This must be
+// called in compile command order so that the result does not depend on the
+// number of workers.
+static void merge_tu_output(CodeModel &model, SymbolIndex &symbols,
+                            DiagnosticCounters      &diagnostics,
+                            const TUOutput          &tu_output,
+                            const ExtractionContext &ctx) {
+  llvm::TimeTraceScope trace_scope("MergeOutput");
 
-    size_t pos = line.find("-c");
-    if (pos == std::string::npos) { continue; }
+  llvm::outs() << tu_output.log;
 
-    pos = line.find_first_of(' ');
-    if (pos == std::string::npos) { continue; }
+  symbols.merge(tu_output.symbols);
+  diagnostics.merge(tu_output.diagnostics);
 
-    std::string working_dir = line.substr(0, pos);
+  const std::vector<std::string> file_paths =
+      tu_output.model.get_file_paths();
+  for (const std::string &file_path : file_paths) {
+    const bool is_new_file = !model.has_file(file_path);
 
-    if (working_dir.find("TryCompile") != std::string::npos) { continue; }
+    model.merge_file(file_path, tu_output.model);
 
-    std::string command = line.substr(pos + 1);
+    if (!ctx.exact_disabled_macros) {
+      if (is_new_file) { collect_disabled_macros(model, file_path); }
+      continue;
+    }
+    model.intersect_disabled_macros(file_path, tu_output.model);
+  }
 
-    std::vector<std::string> commands_vec = tokenize_command(command);
-    if (commands_vec.size() == 0) { continue; }
+  // Only the files of this translation unit are checked, since the other
+  // files are unchanged since the last time.
+  if (!ctx.exact_disabled_macros) {
+    llvm::TimeTraceScope trace_scope("RemoveEnabledMacros");
+    for (const std::string &file_path : file_paths) {
+      model.remove_enabled_macros(file_path);
+    }
+  }
+  return;
+}
 
-    size_t       src_index = -1;
-    const size_t num_tokens = commands_vec.size();
-    for (size_t index = 0; index < num_tokens; index++) {
-      const std::string &token = commands_vec[index];
-      for (const std::string &ext : src_extensions) {
-        if (ends_with(token, ext)) {
-          src_index = index;
-          break;
-        }
-      }
-      if (src_index != -1) { break; }
+static void run_compile_commands(
+    const std::vector<CompileCommand> &commands, const ExtractionContext &ctx,
+    CodeModel &model, SymbolIndex &symbols, DiagnosticCounters &diagnostics) {
+  const size_t   num_commands = commands.size();
+  const uint32_t num_jobs = ctx.num_jobs;
+
+  if (num_jobs <= 1) {
+    for (const CompileCommand &cmd : commands) {
+      TUOutput tu_output;
+      run_compile_command(cmd, ctx, tu_output);
+      merge_tu_output(model, symbols, diagnostics, tu_output, ctx);
     }
+    return;
+  }
 
-    if (src_index == -1) { continue; }
+  // Workers stay at most this many commands ahead of the in-order merge, so
+  // that one slow translation unit does not leave the outputs of all the
+  // later ones in memory.
+  const size_t max_pending =
+      static_cast<size_t>(num_jobs) * MAX_PENDING_PER_JOB;
+
+  std::vector<TUOutput>   tu_outputs(num_commands);
+  std::vector<bool>       finished(num_commands, false);
+  size_t                  next_index = 0;
+  size_t                  num_merged = 0;
+  std::mutex              finished_mutex;
+  std::condition_variable finished_cv;
+
+  auto worker = [&]() {
+    // Each worker records its events on its own track of the trace.
+    if (ctx.trace) {
+      llvm::timeTraceProfilerInitialize(TRACE_GRANULARITY_US, "gen_code_data");
+    }
 
-    std::string src_path = commands_vec[src_index];
+    while (true) {
+      size_t index = 0;
+      {
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        finished_cv.wait(
+            lock, [&]() { return next_index < num_merged + max_pending; });
+        index = next_index++;
+      }
+      if (index >= num_commands) { break; }
 
-    if (src_path.find("conftest") != std::string::npos) { continue; }
-    if (src_path.find("CMakeC") != std::string::npos) { continue; }
+      run_compile_command(commands[index], ctx, tu_outputs[index]);
 
-    bool skip = false;
-    for (const std::string &excl : excludes) {
-      if (src_path.find(excl) != std::string::npos) {
-        skip = true;
-        break;
+      {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        finished[index] = true;
       }
+      finished_cv.notify_all();
     }
 
-    if (skip) { continue; }
+    if (ctx.trace) { llvm::timeTraceProfilerFinishThread(); }
+  };
 
-    commands_vec.erase(commands_vec.begin() + src_index);
+  std::vector<std::thread> workers;
+  for (uint32_t idx = 0; idx < num_jobs; idx++) {
+    workers.emplace_back(worker);
+  }
+
+  for (size_t index = 0; index < num_commands; index++) {
+    {
+      std::unique_lock<std::mutex> lock(finished_mutex);
+      finished_cv.wait(lock, [&]() { return finished[index]; });
+    }
+    merge_tu_output(model, symbols, diagnostics, tu_outputs[index], ctx);
+    tu_outputs[index] = TUOutput();
 
-    auto c_index = std::find(commands_vec.begin(), commands_vec.end(), "-c");
-    if (c_index != commands_vec.end()) { commands_vec.erase(c_index); }
+    {
+      std::lock_guard<std::mutex> lock(finished_mutex);
+      num_merged = index + 1;
+    }
+    finished_cv.notify_all();
+  }
 
-    add_system_include_paths(commands_vec);
+  for (std::thread &worker_thread : workers) {
+    worker_thread.join();
+  }
+  return;
+}
 
-    if (src_path[0] != '/') { src_path = working_dir + "/" + src_path; }
+// Parses the value of -j, a number from 1 to MAX_JOBS.
+static bool parse_num_jobs(const char *value, uint32_t &num_jobs) {
+  if (*value < '0' || *value > '9') { return false; }
 
-    CompileCommand compile_command(working_dir, commands_vec, src_path);
-    commands.push_back(compile_command);
+  char *end = nullptr;
+  const unsigned long parsed = std::strtoul(value, &end, 10);
+  if (*end != '\0' || parsed == 0 || parsed > MAX_JOBS) { return false; }
+
+  num_jobs = parsed;
+  return true;
+}
+
+// Parses "<index>/<count>", e.g. "0/4" for the first of four shards.
+static bool parse_shard(const std::string &value, uint32_t &shard_index,
+                        uint32_t &num_shards) {
+  const size_t slash = value.find('/');
+  if (slash == std::string::npos || slash == 0 || slash + 1 == value.size()) {
+    return false;
   }
 
-  return commands;
+  char *end = nullptr;
+  shard_index = std::strtoul(value.c_str(), &end, 10);
+  if (end != value.c_str() + slash) { return false; }
+  num_shards = std::strtoul(value.c_str() + slash + 1, &end, 10);
+  if (*end != '\0') { return false; }
+
+  return num_shards > 0 && shard_index < num_shards;
 }
 
-static void write_output(const char        *output_filename,
-                         const Json::Value &output_json) {
-  std::ofstream output_file(output_filename);
-  if (!output_file.is_open()) {
-    std::cerr << "Error: could not open output file " << output_filename
-              << "\n";
-    return;
+// The commands of one shard, chosen round-robin in compile command order, so
+// that the slices are deterministic and the translation units of a directory,
+// which tend to cost the same, are spread over all shards.
+static std::vector<CompileCommand> select_shard(
+    const std::vector<CompileCommand> &commands, uint32_t shard_index,
+    uint32_t num_shards) {
+  std::vector<CompileCommand> shard_commands;
+  for (size_t idx = shard_index; idx < commands.size(); idx += num_shards) {
+    shard_commands.push_back(commands[idx]);
   }
+  return shard_commands;
+}
 
-  output_file << output_json.toStyledString();
-  output_file.close();
-  std::cout << "Wrote code data to " << output_filename << "\n";
-  std::cout << "Total files found: " << output_json.size() << "\n";
-  return;
+static void print_usage(const char *program) {
+  std::cout << "Usage: " << program
+            << " [-j <num_jobs>] [--dedup-headers] [--cache-dir <dir>]"
+            << " [--format json|jsonl|binary] [--compact]"
+            << " [--exact-disabled-macros] [--no-dedup-commands]"
+            << " [--one-config-per-file] [--shard <index>/<count>]"
+            << " [--symbol-index <symbols.json>] [--trace <trace.json>]"
+            << " [--diag-json <diagnostics.json>] [-v]"
+            << " <compile_commands.txt|compile_commands.json> <out.json>\n";
+  std::cout << "  The compile commands are read from a JSON compilation"
+            << " database or from the lines written by"
+            << " cc_wrapper/cxx_wrapper.\n";
+  std::cout << "  -j <num_jobs>: Number of translation units processed in"
+            << " parallel, at most " << MAX_JOBS << " (default: 1).\n";
+  std::cout << "  --dedup-headers: Harvest each header only once per"
+            << " configuration instead of once per translation unit. Unsafe"
+            << " for headers that depend on macros defined in the source"
+            << " before they are included.\n";
+  std::cout << "  --cache-dir <dir>: Reuse the output of translation units"
+            << " whose source, arguments and included files are unchanged.\n";
+  std::cout << "  --format json|jsonl|binary: Write one JSON object (default),"
+            << " one JSON line per file or the binary format read by"
+            << " CodeDataReader.\n";
+  std::cout << "  --compact: Write JSON without indentation.\n";
+  std::cout << "  --exact-disabled-macros: Collect disabled macros from the"
+            << " ranges skipped by the preprocessor instead of rereading"
+            << " files.\n";
+  std::cout << "  --no-dedup-commands: Parse every compile command, even if"
+            << " an earlier one parses the same source file the same way.\n";
+  std::cout << "  --one-config-per-file: Parse each source file only with its"
+            << " first compile command.\n";
+  std::cout << "  --shard <index>/<count>: Process only every <count>-th"
+            << " compile command, starting at <index> (0-based). Merge the"
+            << " JSON Lines outputs of all shards with merge_code_data.\n";
+  std::cout << "  --symbol-index <symbols.json>: Also write the functions"
+            << " keyed by a hash of their USR, and the calls between them."
+            << " With --shard, only those of the shard; merge_code_data"
+            << " --shard-symbol-index merges them.\n";
+  std::cout << "  --trace <trace.json>: Write the time spent in each phase and"
+            << " translation unit, including clang's -ftime-trace sections, as"
+            << " Chrome trace events.\n";
+  std::cout << "  --diag-json <diagnostics.json>: Write the number of calls"
+            << " that were not turned into call edges, by reason, with a few"
+            << " samples of each.\n";
+  std::cout << "  -v, --verbose: Log every call that was not turned into a"
+            << " call edge.\n";
+  std::cout << "  It takes the following environment variables:\n";
+  std::cout << "    EXCLUDES: A space-separated list of path fragments to"
+            << " exclude from processing, split with shell quoting.\n";
+  std::cout << "    SYSTEM_PREFIXES: A space-separated list of directories"
+            << " whose files are treated like system headers.\n";
 }
 
 int32_t main(int32_t argc, const char **argv) {
-  if (argc < 3) {
-    std::cout << "Usage: " << argv[0] << " <compile_commands.txt> <out.json>\n";
-    std::cout << "  It takes one environment variable:\n";
-    std::cout << "    EXCLUDES: A space-separated list of path fragments to"
-              << " exclude from processing.\n";
+  ExtractionContext         ctx;
+  bool                      dedup_headers = false;
+  std::string               cache_dir = "";
+  std::string               trace_path = "";
+  std::string               symbol_index_path = "";
+  std::string               diag_path = "";
+  OutputFormat              format = OutputFormat::JSON;
+  bool                      compact = false;
+  bool                      dedup_commands = true;
+  bool                      one_config_per_file = false;
+  uint32_t                  shard_index = 0;
+  uint32_t                  num_shards = 1;
+  std::vector<const char *> positional_args;
+
+  for (int32_t idx = 1; idx < argc; idx++) {
+    const std::string arg = argv[idx];
+    if (arg.rfind("-j", 0) == 0) {
+      const char *value = arg == "-j" ? (idx + 1 < argc ? argv[++idx] : "")
+                                      : argv[idx] + 2;
+      if (!parse_num_jobs(value, ctx.num_jobs)) {
+        std::cerr << "Error: invalid number of jobs: " << value
+                  << " (expected 1 to " << MAX_JOBS << ")\n";
+        return 1;
+      }
+      continue;
+    }
+    if (arg == "--dedup-headers") {
+      dedup_headers = true;
+      continue;
+    }
+    if (arg == "--cache-dir" && idx + 1 < argc) {
+      cache_dir = argv[++idx];
+      continue;
+    }
+    if (arg == "--format" && idx + 1 < argc) {
+      if (!parse_output_format(argv[++idx], format)) {
+        std::cerr << "Error: invalid output format: " << argv[idx] << "\n";
+        return 1;
+      }
+      continue;
+    }
+    if (arg == "--compact") {
+      compact = true;
+      continue;
+    }
+    if (arg == "--exact-disabled-macros") {
+      ctx.exact_disabled_macros = true;
+      continue;
+    }
+    if (arg == "--no-dedup-commands") {
+      dedup_commands = false;
+      continue;
+    }
+    if (arg == "--one-config-per-file") {
+      one_config_per_file = true;
+      continue;
+    }
+    if (arg == "-v" || arg == "--verbose") {
+      ctx.verbose = true;
+      continue;
+    }
+    if (arg == "--diag-json" && idx + 1 < argc) {
+      diag_path = argv[++idx];
+      continue;
+    }
+    if (arg == "--symbol-index" && idx + 1 < argc) {
+      symbol_index_path = argv[++idx];
+      continue;
+    }
+    if (arg == "--trace" && idx + 1 < argc) {
+      trace_path = argv[++idx];
+      ctx.trace = true;
+      continue;
+    }
+    if (arg == "--shard" && idx + 1 < argc) {
+      if (!parse_shard(argv[++idx], shard_index, num_shards)) {
+        std::cerr << "Error: invalid shard: " << argv[idx] << "\n";
+        return 1;
+      }
+      continue;
+    }
+    positional_args.push_back(argv[idx]);
+  }
+
+  if (positional_args.size() < 2) {
+    print_usage(argv[0]);
     return 1;
   }
 
-  const char *compile_commands_path = argv[1];
-  const char *output_filename = argv[2];
+  const char *compile_commands_path = positional_args[0];
+  const char *output_filename = positional_args[1];
+
+  if (ctx.trace) {
+    llvm::timeTraceProfilerInitialize(TRACE_GRANULARITY_US, "gen_code_data");
+  }
 
   get_excludes();
 
-  std::vector<CompileCommand> commands =
-      read_compile_commands(compile_commands_path);
+  std::vector<CompileCommand> commands;
+  {
+    llvm::TimeTraceScope trace_scope("ReadCompileCommands");
+    commands = read_compile_commands(compile_commands_path, excludes);
+  }
 
   if (commands.empty()) {
     std::cerr << "Error: No valid compile commands found.\n";
     return 1;
   }
 
-  fs::path cwd = fs::current_path();
-
-  Json::Value output_json;
-
-  for (const CompileCommand &cmd : commands) {
-    const std::string              &src_path = cmd.src_file_;
-    const std::vector<std::string> &compile_args = cmd.command_;
-    std::ifstream                   src_file(src_path);
-    if (!src_file.is_open()) {
-      std::cerr << "Failed to open source file: " << src_path << "\n";
-      continue;
-    }
-
-    const std::string &working_dir = cmd.working_dir_;
-    if (!fs::exists(working_dir)) {
-      std::cerr << "Warning: working directory does not exist: " << working_dir
-                << "for source file: " << src_path << "\n";
-      continue;
-    }
-
-    std::stringstream src_buffer;
-    src_buffer << src_file.rdbuf();
-    src_file.close();
-
-    const std::string src_code = src_buffer.str();
-
-    fs::current_path(cmd.working_dir_);
+  if (dedup_commands || one_config_per_file) {
+    llvm::TimeTraceScope trace_scope("PlanCompileCommands");
+    const size_t         num_commands = commands.size();
+    commands = plan_compile_commands(commands, one_config_per_file);
+    std::cout << "Planned " << commands.size() << " parses for "
+              << num_commands << " compile commands ("
+              << num_commands - commands.size() << " saved)\n";
+  }
 
-    clang::tooling::runToolOnCodeWithArgs(
-        std::make_unique<CodeDataFrontendAction>(output_json), src_code,
-        compile_args, src_path);
+  // A shard may be empty if there are more shards than compile commands. It
+  // still writes an empty output for the merge.
+  if (num_shards > 1) {
+    commands = select_shard(commands, shard_index, num_shards);
+    std::cout << "Shard " << shard_index << "/" << num_shards << ": "
+              << commands.size() << " compile commands\n";
+  }
 
-    clang::tooling::runToolOnCodeWithArgs(
-        std::make_unique<MacroAction>(output_json), src_code, compile_args,
-        src_path);
+  CodeModel                model;
+  SymbolIndex              symbols;
+  DiagnosticCounters       diagnostics;
+  HeaderRegistry           header_registry;
+  std::unique_ptr<TUCache> cache;
+
+  if (dedup_headers) { ctx.header_registry = &header_registry; }
+  if (!cache_dir.empty()) {
+    // The output of a translation unit depends on how disabled macros are
+    // collected, and its log on -v.
+    std::string options =
+        ctx.exact_disabled_macros ? "exact-disabled-macros" : "";
+    if (ctx.verbose) { options += " verbose"; }
+    cache = std::make_unique<TUCache>(cache_dir, options);
+    ctx.cache = cache.get();
   }
 
-  fs::current_path(cwd);
+  run_compile_commands(commands, ctx, model, symbols, diagnostics);
 
-  write_output(output_filename, output_json);
+  if (cache != nullptr) {
+    std::cout << "Cache hits: " << cache->get_num_hits()
+              << ", misses: " << cache->get_num_misses() << "\n";
+  }
+  std::cout << "Canonical path cache hits: " << get_canonical_path_cache_hits()
+            << ", misses: " << get_canonical_path_cache_misses() << "\n";
+  diagnostics.print_summary(std::cout);
+
+  write_output(output_filename, model, format, compact, num_shards > 1);
+  if (!symbol_index_path.empty()) {
+    {
+      llvm::TimeTraceScope trace_scope("FinalizeSymbolIndex");
+      symbols.finalize();
+    }
+    write_symbol_index(symbol_index_path, symbols, compact);
+  }
+  if (!diag_path.empty()) { write_diagnostics(diag_path, diagnostics); }
+
+  if (ctx.trace) {
+    std::error_code      error;
+    llvm::raw_fd_ostream trace_file(trace_path, error);
+    if (error) {
+      std::cerr << "Error: could not open trace file " << trace_path << "\n";
+    } else {
+      llvm::timeTraceProfilerWrite(trace_file);
+      std::cout << "Wrote trace to " << trace_path << "\n";
+    }
+    llvm::timeTraceProfilerCleanup();
+  }
   return 0;
-}
+}
\ No newline at end of file
@@ -1,16 +1,21 @@
 #include "get_func_list.hpp"
 
-#include <fstream>
 #include <iostream>
-#include <sstream>
 
 #include "clang/Frontend/CompilerInstance.h"
-#include "clang/Tooling/Tooling.h"
-#include "cpp_code_extractor_util.hpp"
 
 ///////////////////////
 // FunctionVisitor class
 ////////////////////////
+bool FunctionVisitor::TraverseDecl(clang::Decl *D) {
+  if (D != nullptr && !llvm::isa<clang::TranslationUnitDecl>(D) &&
+      system_filter_.is_system_loc(D->getLocation())) {
+    return true;
+  }
+
+  return clang::RecursiveASTVisitor<FunctionVisitor>::TraverseDecl(D);
+}
+
 bool FunctionVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
 #if PRINT_DEBUG == 1
   std::cerr << "Visiting function "
@@ -31,7 +36,7 @@ bool FunctionVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
     return true;
   }
 
-  std::cout << func_name << "\n";
+  out_ << func_name << "\n";
 
   return true;
 }
@@ -47,7 +52,8 @@ void FunctionASTConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
 // FunctionFrontendAction class
 ////////////////////////
 
-FunctionFrontendAction::FunctionFrontendAction() {
+FunctionFrontendAction::FunctionFrontendAction(std::ostream &out)
+    : out_(out) {
 }
 
 std::unique_ptr<clang::ASTConsumer> FunctionFrontendAction::CreateASTConsumer(
@@ -65,50 +71,11 @@ std::unique_ptr<clang::ASTConsumer> FunctionFrontendAction::CreateASTConsumer(
   }
 
   llvm::StringRef main_file_name = main_file_ref->getName();
-  return std::make_unique<FunctionASTConsumer>(source_manager, main_file_name);
+  return std::make_unique<FunctionASTConsumer>(source_manager, main_file_name,
+                                               out_);
 }
 
 void FunctionFrontendAction::ExecuteAction() {
   clang::ASTFrontendAction::ExecuteAction();
   return;
-}
-
-/////////////////////////
-// main logic
-/////////////////////////
-
-int main(int argc, const char **argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0]
-              << " <source-file> -- [<compile args> ...]\n";
-    return 1;
-  }
-
-  const char                    *src_path = argv[1];
-  const std::vector<std::string> compile_args = get_compile_args(argc, argv);
-
-#if PRINT_DEBUG == 1
-  std::cerr << "Compile args:\n";
-  for (const auto &arg : compile_args) {
-    std::cerr << arg << " ";
-  }
-  std::cerr << "\n\n";
-#endif
-
-  std::ifstream src_file(src_path);
-
-  if (!src_file.is_open()) {
-    std::cerr << "Error: could not open source file " << src_path << "\n";
-    return 1;
-  }
-
-  std::stringstream src_buffer;
-  src_buffer << src_file.rdbuf();
-  src_file.close();
-
-  clang::tooling::runToolOnCodeWithArgs(
-      std::make_unique<FunctionFrontendAction>(), src_buffer.str(),
-      compile_args, src_path);
-
-  return 0;
 }
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "clang/Tooling/Tooling.h"
+#include "cpp_code_extractor_util.hpp"
+#include "func_query_client.hpp"
+#include "get_func_list.hpp"
+
+/////////////////////////
+// main logic
+/////////////////////////
+
+int main(int argc, const char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " <source-file> -- [<compile args> ...]\n";
+    return 1;
+  }
+
+  const char                    *src_path = argv[1];
+  const std::vector<std::string> compile_args = get_compile_args(argc, argv);
+
+#if PRINT_DEBUG == 1
+  std::cerr << "Compile args:\n";
+  for (const auto &arg : compile_args) {
+    std::cerr << arg << " ";
+  }
+  std::cerr << "\n\n";
+#endif
+
+  // Let a running func_query_server answer from its cached AST
+  const FuncQuery query = {std::filesystem::current_path().string(), "list",
+                           src_path, "", compile_args};
+  int             exit_code = 0;
+  if (run_query_on_server(query, exit_code)) { return exit_code; }
+
+  std::ifstream src_file(src_path);
+
+  if (!src_file.is_open()) {
+    std::cerr << "Error: could not open source file " << src_path << "\n";
+    return 1;
+  }
+
+  std::stringstream src_buffer;
+  src_buffer << src_file.rdbuf();
+  src_file.close();
+
+  clang::tooling::runToolOnCodeWithArgs(
+      std::make_unique<FunctionFrontendAction>(std::cout), src_buffer.str(),
+      compile_args, src_path);
+
+  return 0;
+}
\ No newline at end of file
@@ -1,26 +1,37 @@
 #include "get_func_src.hpp"
 
-#include <fstream>
+#include <cstdint>
 #include <iostream>
-#include <sstream>
 
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Lex/Lexer.h"
-#include "clang/Tooling/Tooling.h"
 #include "cpp_code_extractor_util.hpp"
 
 // /////////////////////////
 // FuncSrcVisitor class
 // /////////////////////////
 
-FuncSrcVisitor::FuncSrcVisitor(clang::SourceManager &src_manager,
-                               clang::LangOptions   &lang_opts,
-                               llvm::StringRef       src_path,
-                               const char           *target_func)
+FuncSrcVisitor::FuncSrcVisitor(
+    clang::SourceManager &src_manager, const clang::LangOptions &lang_opts,
+    llvm::StringRef                        src_path,
+    const std::unordered_set<std::string> &target_funcs,
+    Json::Value *output_json, std::ostream &out)
     : src_manager_(src_manager),
       lang_opts_(lang_opts),
       src_path_(src_path),
-      target_func_(target_func) {
+      target_funcs_(target_funcs),
+      output_json_(output_json),
+      out_(out),
+      system_filter_(src_manager) {
+}
+
+bool FuncSrcVisitor::TraverseDecl(clang::Decl *D) {
+  if (D != nullptr && !llvm::isa<clang::TranslationUnitDecl>(D) &&
+      system_filter_.is_system_loc(D->getLocation())) {
+    return true;
+  }
+
+  return clang::RecursiveASTVisitor<FuncSrcVisitor>::TraverseDecl(D);
 }
 
 bool FuncSrcVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
@@ -28,7 +39,7 @@ bool FuncSrcVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
 
   std::string func_name = FuncDecl->getNameInfo().getName().getAsString();
 
-  if (func_name != target_func_) { return true; }
+  if (target_funcs_.find(func_name) == target_funcs_.end()) { return true; }
 
   clang::SourceLocation loc = FuncDecl->getLocation();
 
@@ -47,7 +58,19 @@ bool FuncSrcVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
                                   src_manager_, lang_opts_)
           .str();
 
-  std::cout << src_code << "\n";
+  if (output_json_ == nullptr) {
+    out_ << src_code << "\n";
+    return true;
+  }
+
+  const int32_t start_line_no = src_manager_.getSpellingLineNumber(start_loc);
+  const int32_t end_line_no = src_manager_.getSpellingLineNumber(end_loc);
+
+  Json::Value func_entry;
+  func_entry["definition"] = src_code;
+  func_entry["start_line"] = start_line_no;
+  func_entry["end_line"] = end_line_no;
+  (*output_json_)[func_name].append(func_entry);
 
   return true;
 }
@@ -56,11 +79,13 @@ bool FuncSrcVisitor::VisitFunctionDecl(clang::FunctionDecl *FuncDecl) {
 // FuncSrcASTConsumer class
 // ////////////////////////
 
-FuncSrcASTConsumer::FuncSrcASTConsumer(clang::SourceManager &src_manager,
-                                       clang::LangOptions   &lang_opts,
-                                       llvm::StringRef       src_path,
-                                       const char           *target_func)
-    : Visitor(src_manager, lang_opts, src_path, target_func) {
+FuncSrcASTConsumer::FuncSrcASTConsumer(
+    clang::SourceManager &src_manager, clang::LangOptions &lang_opts,
+    llvm::StringRef                        src_path,
+    const std::unordered_set<std::string> &target_funcs,
+    Json::Value *output_json, std::ostream &out)
+    : Visitor(src_manager, lang_opts, src_path, target_funcs, output_json,
+              out) {
 }
 
 void FuncSrcASTConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
@@ -71,8 +96,10 @@ void FuncSrcASTConsumer::HandleTranslationUnit(clang::ASTContext &Context) {
 // FuncSrcFrontendAction class
 // ////////////////////////
 
-FuncSrcFrontendAction::FuncSrcFrontendAction(const char *target_func)
-    : target_func_(target_func) {
+FuncSrcFrontendAction::FuncSrcFrontendAction(
+    const std::unordered_set<std::string> &target_funcs,
+    Json::Value *output_json, std::ostream &out)
+    : target_funcs_(target_funcs), output_json_(output_json), out_(out) {
 }
 std::unique_ptr<clang::ASTConsumer> FuncSrcFrontendAction::CreateASTConsumer(
     clang::CompilerInstance &CI, llvm::StringRef InFile) {
@@ -93,7 +120,8 @@ std::unique_ptr<clang::ASTConsumer> FuncSrcFrontendAction::CreateASTConsumer(
   clang::LangOptions &lang_opts = CI.getLangOpts();
 
   return std::make_unique<FuncSrcASTConsumer>(source_manager, lang_opts,
-                                              main_file_name, target_func_);
+                                              main_file_name, target_funcs_,
+                                              output_json_, out_);
 }
 
 void FuncSrcFrontendAction::ExecuteAction() {
@@ -101,36 +129,12 @@ void FuncSrcFrontendAction::ExecuteAction() {
   return;
 }
 
-// ////////////////////////
-// // main function
-// ////////////////////////
-
-int main(int argc, const char **argv) {
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0]
-              << " <source-file> <func_name> -- [<compile args> ...]\n";
-    return 1;
+std::unordered_set<std::string> read_func_names(std::istream &in) {
+  std::unordered_set<std::string> func_names;
+  std::string                     line;
+  while (std::getline(in, line)) {
+    const std::string func_name = strip(line);
+    if (func_name != "") { func_names.insert(func_name); }
   }
-
-  const std::string src_path = argv[1];
-  const char       *func_name = argv[2];
-
-  const std::vector<std::string> compile_args = get_compile_args(argc, argv);
-
-  std::ifstream src_file(src_path);
-
-  if (!src_file.is_open()) {
-    std::cerr << "Error: could not open source file " << src_path << "\n";
-    return 1;
-  }
-
-  std::stringstream src_buffer;
-  src_buffer << src_file.rdbuf();
-  src_file.close();
-
-  clang::tooling::runToolOnCodeWithArgs(
-      std::make_unique<FuncSrcFrontendAction>(func_name), src_buffer.str(),
-      compile_args, src_path);
-
-  return 0;
-}
+  return func_names;
+}
\ No newline at end of file
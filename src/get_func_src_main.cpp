@@ -0,0 +1,82 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "clang/Tooling/Tooling.h"
+#include "cpp_code_extractor_util.hpp"
+#include "func_query_client.hpp"
+#include "get_func_src.hpp"
+
+// ////////////////////////
+// // main function
+// ////////////////////////
+
+int main(int argc, const char **argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <source-file> <func_name> -- [<compile args> ...]\n"
+              << "       " << argv[0]
+              << " <source-file> --names <names-file|-> -- [<compile args> "
+                 "...]\n";
+    return 1;
+  }
+
+  const std::string src_path = argv[1];
+
+  // In batch mode, the function names are read one per line and the
+  // definitions are printed as a JSON object keyed by function name
+  const bool                      batch_mode = strcmp(argv[2], "--names") == 0;
+  std::unordered_set<std::string> func_names;
+  if (!batch_mode) {
+    func_names.insert(argv[2]);
+  } else if (argc < 4) {
+    std::cerr << "Error: --names requires a file path or -\n";
+    return 1;
+  } else if (strcmp(argv[3], "-") == 0) {
+    func_names = read_func_names(std::cin);
+  } else {
+    std::ifstream names_file(argv[3]);
+    if (!names_file.is_open()) {
+      std::cerr << "Error: could not open names file " << argv[3] << "\n";
+      return 1;
+    }
+    func_names = read_func_names(names_file);
+  }
+
+  const std::vector<std::string> compile_args = get_compile_args(argc, argv);
+
+  // Let a running func_query_server answer from its cached AST
+  std::string joined_names;
+  for (const std::string &func_name : func_names) {
+    joined_names += func_name + "\n";
+  }
+  const FuncQuery query = {std::filesystem::current_path().string(),
+                           batch_mode ? "src_batch" : "src", src_path,
+                           batch_mode ? joined_names : argv[2], compile_args};
+  int             exit_code = 0;
+  if (run_query_on_server(query, exit_code)) { return exit_code; }
+
+  std::ifstream src_file(src_path);
+
+  if (!src_file.is_open()) {
+    std::cerr << "Error: could not open source file " << src_path << "\n";
+    return 1;
+  }
+
+  std::stringstream src_buffer;
+  src_buffer << src_file.rdbuf();
+  src_file.close();
+
+  Json::Value output_json = Json::Value(Json::objectValue);
+
+  clang::tooling::runToolOnCodeWithArgs(
+      std::make_unique<FuncSrcFrontendAction>(
+          func_names, batch_mode ? &output_json : nullptr, std::cout),
+      src_buffer.str(), compile_args, src_path);
+
+  if (batch_mode) { std::cout << output_json.toStyledString(); }
+
+  return 0;
+}
\ No newline at end of file
@@ -56,4 +56,53 @@ bool contains_string(const Json::Value &array, const std::string &value) {
     if (item.asString() == value) { return true; }
   }
   return false;
+}
+
+bool contains_value(const Json::Value &array, const Json::Value &value) {
+  for (const Json::Value &item : array) {
+    if (item == value) { return true; }
+  }
+  return false;
+}
+
+// Merge src into dst: objects are merged recursively, arrays are extended with
+// the values not already present, and any other value overwrites dst.
+void merge_json(Json::Value &dst, const Json::Value &src) {
+  if (dst.isObject() && src.isObject()) {
+    for (const std::string &key : src.getMemberNames()) {
+      merge_json(dst[key], src[key]);
+    }
+    return;
+  }
+
+  if (dst.isArray() && src.isArray()) {
+    for (const Json::Value &item : src) {
+      if (!contains_value(dst, item)) { dst.append(item); }
+    }
+    return;
+  }
+
+  dst = src;
+}
+
+// Keeps the definitions in dst that are also in src, i.e. the definitions
+// disabled in every translation unit that preprocessed the file.
+void intersect_disabled_macros(Json::Value &dst, const Json::Value &src) {
+  Json::Value remained = Json::Value(Json::objectValue);
+
+  for (const std::string &macro_name : dst.getMemberNames()) {
+    if (!src.isMember(macro_name)) { continue; }
+    const Json::Value &src_defs = src[macro_name];
+
+    for (const Json::Value &def : dst[macro_name]) {
+      if (!contains_value(src_defs, def)) { continue; }
+      if (!remained.isMember(macro_name)) {
+        remained[macro_name] = Json::Value(Json::arrayValue);
+      }
+      remained[macro_name].append(def);
+    }
+  }
+
+  dst.swap(remained);
+  return;
 }
\ No newline at end of file
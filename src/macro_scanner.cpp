@@ -0,0 +1,106 @@
+#include "macro_scanner.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cpp_code_extractor_util.hpp"
+
+// The characters matched by \s in a std::regex, as strip() removes them.
+static const char *WHITESPACE = " \t\n\v\f\r";
+
+static bool is_space(char c) {
+  return c != '\0' && strchr(WHITESPACE, c) != nullptr;
+}
+
+static bool is_word_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static std::string get_macro_name(const std::string &line) {
+  size_t pos = line.find("define");
+  if (pos == std::string::npos) { return ""; }
+  if (pos + 7 > line.size()) { return ""; }
+  std::string name = line.substr(pos + 7);
+  pos = name.find(' ');
+  if (pos != std::string::npos) { name = name.substr(0, pos); }
+  pos = name.find('\t');
+  if (pos != std::string::npos) { name = name.substr(0, pos); }
+  pos = name.find('(');
+  if (pos != std::string::npos) { name = name.substr(0, pos); }
+  name = strip(name);
+  return name;
+}
+
+// Whether the '#' at hash_pos starts a line of the form `^\s*#\s*define\b`.
+static bool is_define_directive(llvm::StringRef buffer, size_t hash_pos) {
+  for (size_t pos = hash_pos; pos > 0 && buffer[pos - 1] != '\n'; pos--) {
+    if (!is_space(buffer[pos - 1])) { return false; }
+  }
+
+  size_t pos = hash_pos + 1;
+  while (pos < buffer.size() && buffer[pos] != '\n' && is_space(buffer[pos])) {
+    pos++;
+  }
+
+  if (!buffer.substr(pos).starts_with("define")) { return false; }
+  pos += strlen("define");
+  return pos == buffer.size() || !is_word_char(buffer[pos]);
+}
+
+std::vector<MacroDefinitionLine> scan_macro_definitions(
+    llvm::StringRef buffer) {
+  std::vector<MacroDefinitionLine> macros;
+
+  // Newlines are counted lazily, only up to the directives that are found.
+  size_t  counted_pos = 0;
+  int32_t line_no = 0;  // Number of newlines before counted_pos
+
+  size_t pos = 0;
+  while (pos < buffer.size()) {
+    // StringRef::find() is backed by memchr(), which scans a vector register
+    // at a time.
+    const size_t hash_pos = buffer.find('#', pos);
+    if (hash_pos == llvm::StringRef::npos) { break; }
+    pos = hash_pos + 1;
+
+    if (!is_define_directive(buffer, hash_pos)) { continue; }
+
+    size_t line_begin = buffer.rfind('\n', hash_pos);
+    line_begin = line_begin == llvm::StringRef::npos ? 0 : line_begin + 1;
+
+    line_no += std::count(buffer.begin() + counted_pos,
+                          buffer.begin() + line_begin, '\n');
+    line_no++;
+
+    MacroDefinitionLine macro;
+    macro.start_line = line_no - 1;
+
+    size_t          line_end = std::min(buffer.find('\n', line_begin),
+                                        buffer.size());
+    llvm::StringRef line = buffer.slice(line_begin, line_end);
+    macro.definition = line.trim(WHITESPACE).str();
+
+    // A trailing backslash continues the directive on the next line. The end
+    // of the buffer after a final newline counts as one more, empty line.
+    while (line.ends_with("\\") && line_end < buffer.size()) {
+      line_begin = line_end + 1;
+      line_end = std::min(buffer.find('\n', line_begin), buffer.size());
+      line = buffer.slice(line_begin, line_end);
+      line_no++;
+      macro.definition += "\n";
+      macro.definition += line.trim(WHITESPACE).str();
+    }
+    macro.end_line = line_no;
+
+    pos = line_end + 1;
+    counted_pos = std::min(pos, buffer.size());
+
+    macro.name = get_macro_name(macro.definition);
+    if (macro.name.empty()) { continue; }
+
+    macros.push_back(std::move(macro));
+  }
+
+  return macros;
+}
\ No newline at end of file
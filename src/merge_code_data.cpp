@@ -0,0 +1,390 @@
+#include <jsoncpp/json/json.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "code_data_writer.hpp"
+#include "json_utils.hpp"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "symbol_index.hpp"
+
+// ////////////////////////
+// ShardReader class
+// ////////////////////////
+
+// Reads the JSON Lines output of one shard, one file entry at a time. The
+// entries of a shard are sorted by file path, as gen_code_data writes them.
+class ShardReader {
+ public:
+  explicit ShardReader(const std::string &shard_path)
+      : shard_path_(shard_path), in_(shard_path) {
+    Json::CharReaderBuilder builder;
+    reader_.reset(builder.newCharReader());
+  }
+
+  bool is_open() const {
+    return in_.is_open();
+  }
+
+  // Moves to the next entry. Returns false at the end of the shard or on a
+  // malformed or out of order line, in which case error is set.
+  bool next(std::string &error);
+
+  const std::string &get_shard_path() const {
+    return shard_path_;
+  }
+  const std::string &get_file_path() const {
+    return file_path_;
+  }
+  Json::Value &get_file_entry() {
+    return file_entry_;
+  }
+
+ private:
+  std::string                       shard_path_;
+  std::ifstream                     in_;
+  std::unique_ptr<Json::CharReader> reader_;
+  std::string                       file_path_;
+  Json::Value                       file_entry_;
+  size_t                            line_no_ = 0;
+};
+
+bool ShardReader::next(std::string &error) {
+  std::string line;
+  while (std::getline(in_, line)) {
+    line_no_++;
+    if (line.empty()) { continue; }
+
+    Json::Value entry;
+    std::string errors;
+    if (!reader_->parse(line.data(), line.data() + line.size(), &entry,
+                        &errors) ||
+        !entry.isObject() || entry.size() != 1) {
+      error = shard_path_ + ":" + std::to_string(line_no_) +
+              ": not a {\"<file_path>\": {...}} line";
+      return false;
+    }
+
+    const std::string file_path = entry.getMemberNames()[0];
+    if (!file_path_.empty() && file_path <= file_path_) {
+      error = shard_path_ + ":" + std::to_string(line_no_) +
+              ": entries are not sorted by file path";
+      return false;
+    }
+
+    file_path_ = file_path;
+    file_entry_.swap(entry[file_path]);
+    return true;
+  }
+  return false;
+}
+
+// ////////////////////////
+// // main function
+// ////////////////////////
+
+// Names in the "callees" and "callers" arrays of the functions of the entry
+// being merged, so that a function seen by many shards, such as one in a
+// widely included header, is unioned with one hash lookup per name.
+struct CallEdgeSets {
+  llvm::StringSet<> callees;
+  llvm::StringSet<> callers;
+};
+
+using CallEdgeMap = llvm::StringMap<CallEdgeSets>;
+
+// Appends the names of src missing from dst, in the order they are first
+// seen. names mirrors dst, and is filled from dst on first use.
+static void union_names(Json::Value &dst, const Json::Value &src,
+                        llvm::StringSet<> &names) {
+  if (!dst.isArray()) { dst = Json::Value(Json::arrayValue); }
+  if (names.empty()) {
+    for (const Json::Value &name : dst) { names.insert(name.asString()); }
+  }
+
+  for (const Json::Value &name : src) {
+    if (names.insert(name.asString()).second) { dst.append(name); }
+  }
+  return;
+}
+
+static void merge_function(Json::Value &dst, const Json::Value &src,
+                           CallEdgeSets &edges) {
+  if (dst.isNull()) {
+    dst = src;
+    return;
+  }
+
+  for (const std::string &key : src.getMemberNames()) {
+    if (key == "callees") {
+      union_names(dst[key], src[key], edges.callees);
+    } else if (key == "callers") {
+      union_names(dst[key], src[key], edges.callers);
+    } else {
+      merge_json(dst[key], src[key]);
+    }
+  }
+  return;
+}
+
+// Merges the entry of one file from a later shard into the merged entry.
+// Declarations and call edges are unioned, and a macro stays disabled only if
+// it is disabled in every shard that preprocessed the file. The entries of
+// the other shards have no "disabled_macros" key.
+static void merge_file_entry(Json::Value &dst, Json::Value &src,
+                             CallEdgeMap &call_edges) {
+  for (const std::string &key : src.getMemberNames()) {
+    if (key == "functions") {
+      Json::Value       &dst_functions = dst[key];
+      const Json::Value &src_functions = src[key];
+      for (auto function = src_functions.begin();
+           function != src_functions.end(); ++function) {
+        const std::string func_name = function.name();
+        merge_function(dst_functions[func_name], *function,
+                       call_edges[func_name]);
+      }
+    } else if (key != "disabled_macros") {
+      merge_json(dst[key], src[key]);
+    } else if (dst.isMember(key)) {
+      intersect_disabled_macros(dst[key], src[key]);
+    } else {
+      dst[key].swap(src[key]);
+    }
+  }
+  return;
+}
+
+// Orders shards by their current file path. Ties are broken by shard order,
+// so that entries are merged in the order the shards were given.
+struct ShardOrder {
+  const std::vector<std::unique_ptr<ShardReader>> *shards;
+
+  bool operator()(size_t lhs, size_t rhs) const {
+    const std::string &lhs_path = (*shards)[lhs]->get_file_path();
+    const std::string &rhs_path = (*shards)[rhs]->get_file_path();
+    if (lhs_path != rhs_path) { return lhs_path > rhs_path; }
+    return lhs > rhs;
+  }
+};
+
+// k-way merge of the shards. Only the current entry of every shard and the
+// entry being merged are held in memory.
+template <typename Writer>
+static bool merge_shards(std::vector<std::unique_ptr<ShardReader>> &shards,
+                         Writer                                    &writer) {
+  std::priority_queue<size_t, std::vector<size_t>, ShardOrder> heap(
+      ShardOrder{&shards});
+  std::string error;
+
+  for (size_t idx = 0; idx < shards.size(); idx++) {
+    if (shards[idx]->next(error)) {
+      heap.push(idx);
+    } else if (!error.empty()) {
+      std::cerr << "Error: " << error << "\n";
+      return false;
+    }
+  }
+
+  while (!heap.empty()) {
+    const std::string file_path = shards[heap.top()]->get_file_path();
+    Json::Value       file_entry;
+    CallEdgeMap       call_edges;
+
+    while (!heap.empty() && shards[heap.top()]->get_file_path() == file_path) {
+      const size_t idx = heap.top();
+      heap.pop();
+
+      if (file_entry.isNull()) {
+        file_entry.swap(shards[idx]->get_file_entry());
+      } else {
+        merge_file_entry(file_entry, shards[idx]->get_file_entry(),
+                         call_edges);
+      }
+
+      if (shards[idx]->next(error)) {
+        heap.push(idx);
+      } else if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        return false;
+      }
+    }
+
+    // No shard preprocessed the file, which has no disabled macros then.
+    if (!file_entry.isMember("disabled_macros")) {
+      file_entry["disabled_macros"] = Json::Value(Json::objectValue);
+    }
+    writer.write_file_entry(file_path, file_entry);
+  }
+
+  writer.finish();
+  return true;
+}
+
+// Merges the symbol indexes of the shards in shard order, one at a time, and
+// writes the result in the layout of gen_code_data --symbol-index.
+static bool merge_symbol_indexes(
+    const std::string              &index_filename,
+    const std::vector<std::string> &shard_index_paths, bool compact) {
+  SymbolIndex symbols;
+  for (const std::string &shard_index_path : shard_index_paths) {
+    std::ifstream shard_index_file(shard_index_path, std::ios::binary);
+    if (!shard_index_file.is_open()) {
+      std::cerr << "Error: could not open shard symbol index "
+                << shard_index_path << "\n";
+      return false;
+    }
+
+    Json::CharReaderBuilder reader_builder;
+    Json::Value             shard_index_json;
+    std::string             errors;
+    SymbolIndex             shard_symbols;
+    if (!Json::parseFromStream(reader_builder, shard_index_file,
+                               &shard_index_json, &errors) ||
+        !shard_symbols.from_json(shard_index_json)) {
+      std::cerr << "Error: " << shard_index_path
+                << " is not a symbol index\n";
+      return false;
+    }
+    symbols.merge(shard_symbols);
+  }
+  symbols.finalize();
+
+  std::ofstream index_file(index_filename, std::ios::binary);
+  if (!index_file.is_open()) {
+    std::cerr << "Error: could not open symbol index file " << index_filename
+              << "\n";
+    return false;
+  }
+
+  Json::StreamWriterBuilder writer_builder;
+  writer_builder["indentation"] = compact ? "" : "\t";
+  std::unique_ptr<Json::StreamWriter> writer(writer_builder.newStreamWriter());
+  writer->write(symbols.to_json(), &index_file);
+  index_file << "\n";
+
+  index_file.close();
+  std::cout << "Wrote " << symbols.get_num_symbols() << " symbols and "
+            << symbols.get_num_calls() << " calls to " << index_filename
+            << "\n";
+  return true;
+}
+
+static void print_usage(const char *program) {
+  std::cout << "Usage: " << program
+            << " [--format json|jsonl|binary] [--compact]"
+            << " [--symbol-index <symbols.json>"
+            << " --shard-symbol-index <shard_symbols.json> ...] <out.json>"
+            << " <shard.jsonl> ...\n";
+  std::cout << "  Merges the outputs of gen_code_data --shard --format jsonl"
+            << " into one output.\n";
+  std::cout << "  --format json|jsonl|binary: Write one JSON object (default),"
+            << " one JSON line per file or the binary format read by"
+            << " CodeDataReader.\n";
+  std::cout << "  --compact: Write JSON without indentation.\n";
+  std::cout << "  --symbol-index <symbols.json>: Also merge the symbol indexes"
+            << " of the shards, written by gen_code_data --symbol-index.\n";
+  std::cout << "  --shard-symbol-index <shard_symbols.json>: The symbol index"
+            << " of one shard. Give one per shard, in the order of the"
+            << " shards.\n";
+}
+
+int32_t main(int32_t argc, const char **argv) {
+  OutputFormat              format = OutputFormat::JSON;
+  bool                      compact = false;
+  std::string               symbol_index_path = "";
+  std::vector<std::string>  shard_index_paths;
+  std::vector<const char *> positional_args;
+
+  for (int32_t idx = 1; idx < argc; idx++) {
+    const std::string arg = argv[idx];
+    if (arg == "--format" && idx + 1 < argc) {
+      if (!parse_output_format(argv[++idx], format)) {
+        std::cerr << "Error: invalid output format: " << argv[idx] << "\n";
+        return 1;
+      }
+      continue;
+    }
+    if (arg == "--compact") {
+      compact = true;
+      continue;
+    }
+    if (arg == "--symbol-index" && idx + 1 < argc) {
+      symbol_index_path = argv[++idx];
+      continue;
+    }
+    if (arg == "--shard-symbol-index" && idx + 1 < argc) {
+      shard_index_paths.push_back(argv[++idx]);
+      continue;
+    }
+    positional_args.push_back(argv[idx]);
+  }
+
+  if (positional_args.size() < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  // A symbol index merged from only some of the shards would silently miss
+  // symbols and calls.
+  if ((!symbol_index_path.empty() || !shard_index_paths.empty()) &&
+      shard_index_paths.size() != positional_args.size() - 1) {
+    std::cerr << "Error: --symbol-index needs one --shard-symbol-index per"
+              << " shard\n";
+    return 1;
+  }
+  if (symbol_index_path.empty() && !shard_index_paths.empty()) {
+    std::cerr << "Error: --shard-symbol-index needs --symbol-index\n";
+    return 1;
+  }
+
+  const char *output_filename = positional_args[0];
+
+  std::vector<std::unique_ptr<ShardReader>> shards;
+  for (size_t idx = 1; idx < positional_args.size(); idx++) {
+    shards.push_back(std::make_unique<ShardReader>(positional_args[idx]));
+    if (!shards.back()->is_open()) {
+      std::cerr << "Error: could not open shard " << positional_args[idx]
+                << "\n";
+      return 1;
+    }
+  }
+
+  std::ofstream output_file(output_filename, std::ios::binary);
+  if (!output_file.is_open()) {
+    std::cerr << "Error: could not open output file " << output_filename
+              << "\n";
+    return 1;
+  }
+
+  bool   success = false;
+  size_t num_files = 0;
+  if (format == OutputFormat::BINARY) {
+    BinaryCodeDataWriter writer(output_file);
+    success = merge_shards(shards, writer);
+    num_files = writer.get_num_entries();
+  } else {
+    CodeDataWriter writer(output_file, format, compact);
+    success = merge_shards(shards, writer);
+    num_files = writer.get_num_entries();
+  }
+  output_file.close();
+
+  if (!success) { return 1; }
+
+  std::cout << "Merged " << shards.size() << " shards into "
+            << output_filename << "\n";
+  std::cout << "Total files found: " << num_files << "\n";
+
+  if (!symbol_index_path.empty() &&
+      !merge_symbol_indexes(symbol_index_path, shard_index_paths, compact)) {
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "symbol_index.hpp"
+
+#include <algorithm>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/xxhash.h"
+
+SymbolID get_symbol_id(llvm::StringRef usr) {
+  const SymbolID max_id = llvm::DenseMapInfo<SymbolID>::getTombstoneKey() - 1;
+  return std::clamp<SymbolID>(llvm::xxh3_64bits(usr), 1, max_id);
+}
+
+llvm::StringRef SymbolIndex::intern(llvm::StringRef str) {
+  if (str.empty()) { return ""; }
+  return strings_.insert(str).first->getKey();
+}
+
+void SymbolIndex::add_symbol(SymbolID id, llvm::StringRef name,
+                             llvm::StringRef qualified_name,
+                             llvm::StringRef file_path, int32_t start_line,
+                             int32_t end_line) {
+  auto inserted = symbols_.try_emplace(id);
+  Symbol &symbol = inserted.first->second;
+
+  if (inserted.second) {
+    symbol.name = intern(name);
+    symbol.qualified_name = intern(qualified_name);
+    names_[name].push_back(id);
+  }
+  if (file_path.empty()) { return; }
+
+  symbol.file_path = intern(file_path);
+  symbol.start_line = start_line;
+  symbol.end_line = end_line;
+}
+
+void SymbolIndex::add_call(SymbolID caller, SymbolID callee) {
+  calls_.emplace_back(caller, callee);
+}
+
+void SymbolIndex::merge(const SymbolIndex &other) {
+  for (const auto &entry : other.symbols_) {
+    const Symbol &symbol = entry.second;
+    add_symbol(entry.first, symbol.name, symbol.qualified_name,
+               symbol.file_path, symbol.start_line, symbol.end_line);
+  }
+  calls_.insert(calls_.end(), other.calls_.begin(), other.calls_.end());
+}
+
+void SymbolIndex::finalize() {
+  llvm::parallelSort(calls_.begin(), calls_.end());
+  calls_.erase(std::unique(calls_.begin(), calls_.end()), calls_.end());
+
+  // Every symbol with a call is a node, numbered in SymbolID order.
+  std::vector<SymbolID> nodes;
+  nodes.reserve(calls_.size() * 2);
+  for (const std::pair<SymbolID, SymbolID> &call : calls_) {
+    nodes.push_back(call.first);
+    nodes.push_back(call.second);
+  }
+  llvm::parallelSort(nodes.begin(), nodes.end());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+  node_index_.clear();
+  node_index_.reserve(nodes.size());
+  for (uint32_t idx = 0; idx < nodes.size(); idx++) {
+    node_index_[nodes[idx]] = idx;
+  }
+
+  // Counting sort by node. The calls are sorted by caller and then callee,
+  // so both the callees and the callers of a node come out sorted.
+  callees_.offsets.assign(nodes.size() + 1, 0);
+  callers_.offsets.assign(nodes.size() + 1, 0);
+  std::vector<uint32_t> caller_nodes(calls_.size());
+  std::vector<uint32_t> callee_nodes(calls_.size());
+  for (size_t idx = 0; idx < calls_.size(); idx++) {
+    caller_nodes[idx] = node_index_[calls_[idx].first];
+    callee_nodes[idx] = node_index_[calls_[idx].second];
+    callees_.offsets[caller_nodes[idx] + 1]++;
+    callers_.offsets[callee_nodes[idx] + 1]++;
+  }
+  for (size_t idx = 1; idx <= nodes.size(); idx++) {
+    callees_.offsets[idx] += callees_.offsets[idx - 1];
+    callers_.offsets[idx] += callers_.offsets[idx - 1];
+  }
+
+  callees_.targets.resize(calls_.size());
+  callers_.targets.resize(calls_.size());
+  std::vector<uint32_t> callee_pos(callees_.offsets.begin(),
+                                   callees_.offsets.end() - 1);
+  std::vector<uint32_t> caller_pos(callers_.offsets.begin(),
+                                   callers_.offsets.end() - 1);
+  for (size_t idx = 0; idx < calls_.size(); idx++) {
+    callees_.targets[callee_pos[caller_nodes[idx]]++] = calls_[idx].second;
+    callers_.targets[caller_pos[callee_nodes[idx]]++] = calls_[idx].first;
+  }
+}
+
+const SymbolIndex::Symbol *SymbolIndex::find(SymbolID id) const {
+  auto symbol = symbols_.find(id);
+  return symbol == symbols_.end() ? nullptr : &symbol->second;
+}
+
+llvm::ArrayRef<SymbolID> SymbolIndex::find_by_name(llvm::StringRef name) const {
+  auto ids = names_.find(name);
+  if (ids == names_.end()) { return {}; }
+  return ids->getValue();
+}
+
+llvm::ArrayRef<SymbolID> SymbolIndex::get_neighbors(
+    const Adjacency &adjacency, SymbolID id) const {
+  auto node = node_index_.find(id);
+  if (node == node_index_.end()) { return {}; }
+  const uint32_t begin = adjacency.offsets[node->second];
+  const uint32_t end = adjacency.offsets[node->second + 1];
+  return llvm::ArrayRef<SymbolID>(adjacency.targets).slice(begin, end - begin);
+}
+
+llvm::ArrayRef<SymbolID> SymbolIndex::get_callees(SymbolID id) const {
+  return get_neighbors(callees_, id);
+}
+
+llvm::ArrayRef<SymbolID> SymbolIndex::get_callers(SymbolID id) const {
+  return get_neighbors(callers_, id);
+}
+
+Json::Value SymbolIndex::to_json() const {
+  Json::Value json(Json::objectValue);
+
+  Json::Value &symbols = json["symbols"];
+  symbols = Json::Value(Json::objectValue);
+  for (const auto &entry : symbols_) {
+    const Symbol &symbol = entry.second;
+    Json::Value  &symbol_entry = symbols[llvm::utohexstr(entry.first)];
+    symbol_entry["name"] = symbol.name.str();
+    symbol_entry["qualified_name"] = symbol.qualified_name.str();
+    if (symbol.file_path.empty()) { continue; }
+    symbol_entry["file"] = symbol.file_path.str();
+    symbol_entry["start_line"] = symbol.start_line;
+    symbol_entry["end_line"] = symbol.end_line;
+  }
+
+  Json::Value &calls = json["calls"];
+  calls = Json::Value(Json::arrayValue);
+  for (const std::pair<SymbolID, SymbolID> &call : calls_) {
+    Json::Value &call_entry = calls.append(Json::Value(Json::arrayValue));
+    call_entry.append(llvm::utohexstr(call.first));
+    call_entry.append(llvm::utohexstr(call.second));
+  }
+  return json;
+}
+
+static bool parse_symbol_id(const Json::Value &value, SymbolID &id) {
+  return value.isString() &&
+         !llvm::StringRef(value.asString()).getAsInteger(16, id);
+}
+
+bool SymbolIndex::from_json(const Json::Value &json) {
+  if (!json.isObject() || !json["symbols"].isObject() ||
+      !json["calls"].isArray()) {
+    return false;
+  }
+
+  const Json::Value &symbols = json["symbols"];
+  for (auto entry = symbols.begin(); entry != symbols.end(); ++entry) {
+    SymbolID id = 0;
+    if (!parse_symbol_id(entry.key(), id) || !entry->isObject()) {
+      return false;
+    }
+    add_symbol(id, (*entry)["name"].asString(),
+               (*entry)["qualified_name"].asString(),
+               (*entry)["file"].asString(), (*entry)["start_line"].asInt(),
+               (*entry)["end_line"].asInt());
+  }
+
+  for (const Json::Value &call : json["calls"]) {
+    SymbolID caller = 0;
+    SymbolID callee = 0;
+    if (!call.isArray() || call.size() != 2 ||
+        !parse_symbol_id(call[0], caller) ||
+        !parse_symbol_id(call[1], callee)) {
+      return false;
+    }
+    add_call(caller, callee);
+  }
+
+  finalize();
+  return true;
+}
\ No newline at end of file
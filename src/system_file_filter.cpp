@@ -0,0 +1,34 @@
+#include "system_file_filter.hpp"
+
+#include "cpp_code_extractor_util.hpp"
+
+SystemFileFilter::SystemFileFilter(clang::SourceManager &src_manager,
+                                   const std::string    &working_dir)
+    : src_manager_(src_manager), working_dir_(working_dir) {
+}
+
+bool SystemFileFilter::is_system_loc(clang::SourceLocation loc) {
+  if (loc.isInvalid()) { return false; }
+
+  const clang::FileID file_id =
+      src_manager_.getFileID(src_manager_.getExpansionLoc(loc));
+  if (file_id.isInvalid()) { return false; }
+
+  auto cached = system_files_.find(file_id);
+  if (cached != system_files_.end()) { return cached->second; }
+
+  bool is_system = false;
+
+  clang::OptionalFileEntryRef file_ref =
+      src_manager_.getFileEntryRefForID(file_id);
+  if (file_ref) {
+    // The include directories reported by clang are not always canonical, so
+    // both the name clang used and the canonical path are checked.
+    const std::string file_name = file_ref->getName().str();
+    is_system = is_system_file(file_name) ||
+                is_system_file(get_canonical_abs_path(file_name, working_dir_));
+  }
+
+  system_files_[file_id] = is_system;
+  return is_system;
+}
\ No newline at end of file
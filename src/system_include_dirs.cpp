@@ -0,0 +1,252 @@
+#include "system_include_dirs.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "cpp_code_extractor_util.hpp"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/xxhash.h"
+
+std::string get_driver_for_source(const std::string              &src_path,
+                                  const std::vector<std::string> &args) {
+  for (size_t idx = 0; idx + 1 < args.size(); idx++) {
+    if (args[idx] != "-x") { continue; }
+    const std::string &language = args[idx + 1];
+    return language == "c" || language == "c-header" ? "clang" : "clang++";
+  }
+  return ends_with(src_path, ".c") ? "clang" : "clang++";
+}
+
+static bool is_cxx_driver(const std::string &driver) {
+  return llvm::StringRef(driver).contains("++");
+}
+
+// Parse the search list printed by "<driver> -E -v".
+static std::vector<std::string> run_driver(const std::string &driver) {
+  std::vector<std::string> dirs;
+
+  const std::string cmd = driver + " -E -x " +
+                          (is_cxx_driver(driver) ? "c++" : "c") +
+                          " - -v < /dev/null 2>&1";
+  FILE *fp = popen(cmd.c_str(), "r");
+  if (fp == NULL) {
+    std::cerr << "Error: could not run command: " << cmd << "\n";
+    return dirs;
+  }
+
+  char buffer[256];
+  bool found_include_start = false;
+  while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+    std::string line(buffer);
+    if (found_include_start) {
+      if (line.find("End of search list.") != std::string::npos) {
+        found_include_start = false;
+        continue;
+      }
+
+      if (line.find("starts here") != std::string::npos) { continue; }
+
+      if (line.empty()) { continue; }
+
+      if (line[0] == ' ') { line = line.substr(1); }
+
+      const size_t len = line.length();
+
+      if (line[len - 1] == '\n') { line = line.substr(0, len - 1); }
+
+      dirs.push_back(line);
+      continue;
+    }
+
+    if (line.find("#include <...> search starts here") != std::string::npos) {
+      found_include_start = true;
+      continue;
+    }
+
+    if (line.find("#include \"...\" search starts here") != std::string::npos) {
+      found_include_start = true;
+      continue;
+    }
+  }
+  pclose(fp);
+  return dirs;
+}
+
+// Let the clang driver build a compiler invocation, the same way it would for
+// "<driver> -c", and read the include directories it adds. The language is
+// passed in, since the resolved driver_path is usually "clang-NN" for both
+// "clang" and "clang++".
+static std::vector<std::string> query_driver(const std::string &driver_path,
+                                             bool               is_cxx) {
+  std::vector<std::string> dirs;
+
+  const char *args[] = {driver_path.c_str(),
+                        is_cxx ? "--driver-mode=g++" : "--driver-mode=gcc",
+                        "-fsyntax-only",
+                        "-x",
+                        is_cxx ? "c++" : "c",
+                        is_cxx ? "dummy.cpp" : "dummy.c"};
+
+  llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diags =
+      new clang::DiagnosticsEngine(new clang::DiagnosticIDs(),
+                                   new clang::DiagnosticOptions(),
+                                   new clang::IgnoringDiagConsumer());
+  clang::CreateInvocationOptions options;
+  options.Diags = diags;
+
+  std::unique_ptr<clang::CompilerInvocation> invocation =
+      clang::createInvocation(args, options);
+  if (invocation == nullptr) { return dirs; }
+
+  const clang::HeaderSearchOptions &header_search_opts =
+      invocation->getHeaderSearchOpts();
+
+  // Search order is by group first, as in "clang -v".
+  std::vector<clang::HeaderSearchOptions::Entry> entries =
+      header_search_opts.UserEntries;
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const clang::HeaderSearchOptions::Entry &lhs,
+                      const clang::HeaderSearchOptions::Entry &rhs) {
+                     return lhs.Group < rhs.Group;
+                   });
+
+  for (const clang::HeaderSearchOptions::Entry &entry : entries) {
+    if (entry.IsFramework) { continue; }
+    if (entry.Group == clang::frontend::Quoted) { continue; }
+
+    std::string dir = entry.Path;
+    if (!entry.IgnoreSysRoot && header_search_opts.Sysroot != "/" &&
+        llvm::sys::path::is_absolute(dir)) {
+      dir = header_search_opts.Sysroot + dir;
+    }
+    if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+      dirs.push_back(dir);
+    }
+  }
+
+  return dirs;
+}
+
+// The cache file of a driver binary and language, or "" if there is no cache
+// directory. The key includes the size and modification time of the binary,
+// so that an upgrade of the compiler invalidates the entry, and the clang
+// version this tool is built with, since it computes the directories
+// in-process.
+static std::string get_cache_path(const std::string &driver_path,
+                                  bool               is_cxx) {
+  llvm::SmallString<256> cache_dir;
+  if (const char *xdg_cache_home = std::getenv("XDG_CACHE_HOME")) {
+    cache_dir = xdg_cache_home;
+  } else if (const char *home = std::getenv("HOME")) {
+    cache_dir = home;
+    llvm::sys::path::append(cache_dir, ".cache");
+  } else {
+    return "";
+  }
+  llvm::sys::path::append(cache_dir, "cpp_code_extractor");
+
+  std::string key = driver_path;
+  key += '\0';
+  key += is_cxx ? "c++" : "c";
+  key += '\0';
+  key += CLANG_VERSION_STRING;
+
+  llvm::sys::fs::file_status status;
+  if (!llvm::sys::fs::status(driver_path, status)) {
+    key += '\0';
+    key += std::to_string(status.getSize());
+    key += '\0';
+    key += std::to_string(
+        status.getLastModificationTime().time_since_epoch().count());
+  }
+
+  const std::string file_name =
+      "include_dirs-" + llvm::utohexstr(llvm::xxh3_64bits(key)) + ".txt";
+  llvm::sys::path::append(cache_dir, file_name);
+  return std::string(cache_dir);
+}
+
+static bool load_cache(const std::string        &cache_path,
+                       std::vector<std::string> &dirs) {
+  std::ifstream cache_file(cache_path);
+  if (!cache_file.is_open()) { return false; }
+
+  std::string line;
+  while (std::getline(cache_file, line)) {
+    if (!line.empty()) { dirs.push_back(line); }
+  }
+  return !dirs.empty();
+}
+
+// Written to a unique temporary file first, so that concurrent runs never see
+// a partial cache file.
+static void store_cache(const std::string              &cache_path,
+                        const std::vector<std::string> &dirs) {
+  if (llvm::sys::fs::create_directories(
+          llvm::sys::path::parent_path(cache_path))) {
+    return;
+  }
+
+  llvm::SmallString<256> tmp_path;
+  llvm::sys::fs::createUniquePath(cache_path + "-%%%%%%%%", tmp_path,
+                                  /*MakeAbsolute=*/false);
+  {
+    std::ofstream tmp_file(tmp_path.c_str());
+    if (!tmp_file.is_open()) { return; }
+    for (const std::string &dir : dirs) { tmp_file << dir << "\n"; }
+  }
+
+  if (llvm::sys::fs::rename(tmp_path, cache_path)) {
+    llvm::sys::fs::remove(tmp_path);
+  }
+}
+
+static std::vector<std::string> find_system_include_dirs(
+    const std::string &driver) {
+  std::string driver_path = driver;
+  llvm::ErrorOr<std::string> found = llvm::sys::findProgramByName(driver);
+  if (found) {
+    // The driver derives its resource directory from its own location.
+    const std::string canonical_path = get_canonical_abs_path(*found);
+    driver_path = canonical_path.empty() ? *found : canonical_path;
+  }
+
+  std::vector<std::string> dirs;
+
+  const bool        is_cxx = is_cxx_driver(driver);
+  const std::string cache_path = get_cache_path(driver_path, is_cxx);
+  if (!cache_path.empty() && load_cache(cache_path, dirs)) { return dirs; }
+
+  dirs = query_driver(driver_path, is_cxx);
+  if (dirs.empty()) { dirs = run_driver(driver); }
+
+  if (!cache_path.empty() && !dirs.empty()) { store_cache(cache_path, dirs); }
+  return dirs;
+}
+
+const std::vector<std::string> &get_system_include_dirs(
+    const std::string &driver) {
+  static std::mutex                                      mutex;
+  static std::map<std::string, std::vector<std::string>> dirs_by_driver;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto                        cached = dirs_by_driver.find(driver);
+  if (cached != dirs_by_driver.end()) { return cached->second; }
+
+  return dirs_by_driver.emplace(driver, find_system_include_dirs(driver))
+      .first->second;
+}
\ No newline at end of file
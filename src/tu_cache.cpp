@@ -0,0 +1,178 @@
+#include "tu_cache.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+
+namespace fs = std::filesystem;
+
+// Bump this whenever the extracted data changes, to invalidate old entries.
+static const char *TU_CACHE_VERSION = "gen_code_data-5";
+
+TUCache::TUCache(const std::string &cache_dir, const std::string &options)
+    : cache_dir_(cache_dir), options_(options) {
+  std::error_code ec;
+  fs::create_directories(cache_dir_, ec);
+  if (ec) {
+    std::cerr << "Warning: could not create cache directory " << cache_dir_
+              << ": " << ec.message() << "\n";
+  }
+}
+
+std::string TUCache::get_entry_path(const CompileCommand &cmd,
+                                    const std::string    &src_code) const {
+  std::string key = TU_CACHE_VERSION;
+  key += '\0';
+  key += options_;
+  key += '\0';
+  key += cmd.working_dir_;
+  key += '\0';
+  key += cmd.src_file_;
+  for (const std::string &arg : cmd.command_) {
+    key += '\0';
+    key += arg;
+  }
+  key += '\0';
+  key += src_code;
+
+  return cache_dir_ + "/" + llvm::utohexstr(llvm::xxh3_64bits(key)) + ".json";
+}
+
+bool TUCache::get_file_hash(const std::string &file_path, uint64_t &hash) {
+  {
+    std::lock_guard<std::mutex> lock(file_hashes_mutex_);
+    auto                        cached = file_hashes_.find(file_path);
+    if (cached != file_hashes_.end()) {
+      hash = cached->second;
+      return true;
+    }
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(file_path);
+  if (!buffer) { return false; }
+
+  hash = llvm::xxh3_64bits((*buffer)->getBuffer());
+
+  std::lock_guard<std::mutex> lock(file_hashes_mutex_);
+  file_hashes_[file_path] = hash;
+  return true;
+}
+
+bool TUCache::load(const CompileCommand &cmd, const std::string &src_code,
+                   TUOutput &tu_output) {
+  const std::string entry_path = get_entry_path(cmd, src_code);
+
+  std::ifstream entry_file(entry_path);
+  if (!entry_file.is_open()) {
+    num_misses_++;
+    return false;
+  }
+
+  Json::CharReaderBuilder reader_builder;
+  Json::Value             entry;
+  std::string             errors;
+  if (!Json::parseFromStream(reader_builder, entry_file, &entry, &errors)) {
+    std::cerr << "Warning: ignoring corrupted cache entry " << entry_path
+              << "\n";
+    num_misses_++;
+    return false;
+  }
+
+  if (!entry.isObject() || !entry["dependencies"].isObject() ||
+      !entry["data"].isObject() || !entry["log"].isString() ||
+      !entry["symbols"].isObject() || !entry["diagnostics"].isObject()) {
+    num_misses_++;
+    return false;
+  }
+
+  const Json::Value &dependencies = entry["dependencies"];
+  for (const std::string &file_path : dependencies.getMemberNames()) {
+    uint64_t hash = 0;
+    if (!get_file_hash(file_path, hash) ||
+        dependencies[file_path].asString() != llvm::utohexstr(hash)) {
+      num_misses_++;
+      return false;
+    }
+  }
+
+  SymbolIndex        symbols;
+  DiagnosticCounters diagnostics;
+  if (!symbols.from_json(entry["symbols"]) ||
+      !diagnostics.from_json(entry["diagnostics"])) {
+    num_misses_++;
+    return false;
+  }
+
+  // Disabled macros are only cached for the files whose disabled macros the
+  // translation unit knows, see CodeModel::to_json().
+  CodeModel          model;
+  const Json::Value &data = entry["data"];
+  for (auto file = data.begin(); file != data.end(); ++file) {
+    const std::string file_path = file.name();
+    model.merge_file_entry(file_path, *file);
+    if (file->isMember("disabled_macros")) {
+      model.intersect_disabled_macros(file_path, (*file)["disabled_macros"]);
+    }
+  }
+
+  tu_output.model = std::move(model);
+  tu_output.symbols = std::move(symbols);
+  tu_output.diagnostics = std::move(diagnostics);
+  tu_output.log = entry["log"].asString();
+  tu_output.dependencies = dependencies.getMemberNames();
+  num_hits_++;
+  return true;
+}
+
+void TUCache::store(const CompileCommand &cmd, const std::string &src_code,
+                    const TUOutput &tu_output) {
+  Json::Value entry = Json::Value(Json::objectValue);
+
+  Json::Value &dependencies = entry["dependencies"];
+  dependencies = Json::Value(Json::objectValue);
+  for (const std::string &file_path : tu_output.dependencies) {
+    uint64_t hash = 0;
+    if (!get_file_hash(file_path, hash)) { return; }
+    dependencies[file_path] = llvm::utohexstr(hash);
+  }
+
+  Json::Value &data = entry["data"];
+  data = Json::Value(Json::objectValue);
+  for (const std::string &file_path : tu_output.model.get_file_paths()) {
+    data[file_path] = tu_output.model.to_json(file_path, true);
+  }
+  entry["log"] = tu_output.log;
+  entry["symbols"] = tu_output.symbols.to_json();
+  entry["diagnostics"] = tu_output.diagnostics.to_json();
+
+  // Write to a unique temporary file first, so that concurrent workers and
+  // concurrent runs never observe a partially written entry.
+  const std::string      entry_path = get_entry_path(cmd, src_code);
+  llvm::SmallString<256> tmp_path;
+  llvm::sys::fs::createUniquePath(entry_path + ".tmp-%%%%%%%%", tmp_path,
+                                  false);
+
+  std::ofstream tmp_file(tmp_path.str().str());
+  if (!tmp_file.is_open()) {
+    std::cerr << "Warning: could not write cache entry " << entry_path << "\n";
+    return;
+  }
+
+  Json::StreamWriterBuilder writer_builder;
+  writer_builder["indentation"] = "";
+  tmp_file << Json::writeString(writer_builder, entry);
+  tmp_file.close();
+
+  if (std::rename(tmp_path.c_str(), entry_path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+  }
+  return;
+}
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include <jsoncpp/json/json.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "code_data_format.hpp"
+#include "code_data_reader.hpp"
+#include "code_data_writer.hpp"
+
+// Writes code data in the binary format, reads it back with CodeDataReader
+// and checks that every record survived, and that a file with a corrupted
+// string table is rejected.
+
+static int num_failures = 0;
+
+static void check(bool condition, const std::string &what) {
+  if (condition) { return; }
+  std::cerr << "FAILED: " << what << "\n";
+  num_failures++;
+}
+
+static Json::Value make_record(const std::string &definition,
+                               uint32_t start_line, uint32_t end_line) {
+  Json::Value record(Json::objectValue);
+  record["definition"] = definition;
+  record["start_line"] = start_line;
+  record["end_line"] = end_line;
+  return record;
+}
+
+// A file entry in the layout of CodeModel::to_json().
+static Json::Value make_file_entry() {
+  Json::Value entry(Json::objectValue);
+
+  Json::Value &function = entry["functions"]["main"];
+  function = make_record("int main() { return helper(); }", 3, 5);
+  function["variables"]["count"] = make_record("int count = 0;", 4, 4);
+  function["callees"].append("helper");
+
+  Json::Value &helper = entry["functions"]["helper"];
+  helper = make_record("int helper() { return 1; }", 1, 1);
+  helper["callers"].append("main");
+
+  entry["macros"]["ENABLED"] = make_record("#define ENABLED 1", 7, 7);
+  entry["enums"] = Json::Value(Json::objectValue);
+  entry["types"]["Point"] = make_record("struct Point { int x; };", 9, 9);
+  entry["global_variables"]["g_value"] = make_record("int g_value;", 11, 11);
+
+  Json::Value &disabled = entry["disabled_macros"]["FEATURE"];
+  disabled = Json::Value(Json::arrayValue);
+  disabled.append(make_record("#define FEATURE 1", 13, 13));
+  disabled.append(make_record("#define FEATURE 2", 15, 15));
+  return entry;
+}
+
+// Points the first string past the end of the string data, while the last
+// offset stays within it.
+static void corrupt_string_offsets(const std::string &data_path) {
+  std::string data;
+  {
+    std::ifstream in(data_path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+  }
+
+  CodeDataHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  const uint64_t offset = header.string_data_size + 1000000;
+  memcpy(&data[header.string_offsets_offset + sizeof(uint64_t)], &offset,
+         sizeof(offset));
+
+  std::ofstream out(data_path, std::ios::binary);
+  out.write(data.data(), data.size());
+}
+
+int main() {
+  const std::string file_path = "/src/main.cpp";
+  const std::string data_path = "code_data_roundtrip_test.bin";
+
+  {
+    std::ofstream        out(data_path, std::ios::binary);
+    BinaryCodeDataWriter writer(out);
+    writer.write_file_entry(file_path, make_file_entry());
+    writer.finish();
+  }
+
+  CodeDataReader reader;
+  check(reader.open(data_path), "open");
+
+  corrupt_string_offsets(data_path);
+  CodeDataReader corrupted_reader;
+  check(!corrupted_reader.open(data_path), "reject corrupted string offsets");
+  std::remove(data_path.c_str());
+  if (num_failures != 0) { return 1; }
+
+  check(reader.get_records().size() == 8, "number of records");
+
+  const CodeDataRecord *main_record =
+      reader.find(CodeDataKind::FUNCTION, "main", file_path);
+  check(main_record != nullptr, "function main");
+  if (main_record != nullptr) {
+    check(reader.get_string(main_record->definition) ==
+              "int main() { return helper(); }",
+          "definition of main");
+    check(main_record->start_line == 3 && main_record->end_line == 5,
+          "lines of main");
+    llvm::ArrayRef<uint32_t> callees = reader.get_callees(*main_record);
+    check(callees.size() == 1 && reader.get_string(callees[0]) == "helper",
+          "callees of main");
+  }
+
+  const CodeDataRecord *helper_record =
+      reader.find(CodeDataKind::FUNCTION, "helper", file_path);
+  check(helper_record != nullptr, "function helper");
+  if (helper_record != nullptr) {
+    llvm::ArrayRef<uint32_t> callers = reader.get_callers(*helper_record);
+    check(callers.size() == 1 && reader.get_string(callers[0]) == "main",
+          "callers of helper");
+  }
+
+  const CodeDataRecord *variable =
+      reader.find(CodeDataKind::VARIABLE, "count", file_path);
+  check(variable != nullptr && reader.get_string(variable->parent) == "main",
+        "local variable count");
+  check(reader.find(CodeDataKind::MACRO, "ENABLED", file_path) != nullptr,
+        "macro ENABLED");
+  check(reader.find(CodeDataKind::TYPE, "Point", file_path) != nullptr,
+        "type Point");
+  check(reader.find(CodeDataKind::GLOBAL_VARIABLE, "g_value", file_path) !=
+            nullptr,
+        "global variable g_value");
+
+  llvm::ArrayRef<CodeDataRecord> disabled =
+      reader.find(CodeDataKind::DISABLED_MACRO, "FEATURE");
+  check(disabled.size() == 2, "both definitions of disabled macro FEATURE");
+  bool has_first = false;
+  bool has_second = false;
+  for (const CodeDataRecord &record : disabled) {
+    const llvm::StringRef definition = reader.get_string(record.definition);
+    has_first |= definition == "#define FEATURE 1" && record.start_line == 13;
+    has_second |= definition == "#define FEATURE 2" && record.start_line == 15;
+  }
+  check(has_first && has_second, "definitions of disabled macro FEATURE");
+
+  if (num_failures != 0) { return 1; }
+  std::cout << "code_data_roundtrip_test: OK\n";
+  return 0;
+}
\ No newline at end of file